@@ -0,0 +1,661 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  University of Leeds
+//  COMP 5892M Advanced Rendering
+//  User Interface for Coursework
+//
+//  ------------------------
+//  bench.cpp
+//  ------------------------
+//
+//  Benchmarks without any window, for every scene in objects/ or for the
+//  one given. For each scene: the scene build and update times, ray query
+//  throughput of the acceleration structure layouts, the ray-triangle
+//  kernels, frames rendered under fixed cameras and feature sets with
+//  their ray rates, and the specialised shading kernels against the
+//  generic one. --json also writes it all out for scripts.
+//  Run from the repository root:
+//      bench [geometry material] [--subdivide N] [--size W H] [--render-size W H] [--json FILE]
+//
+///////////////////////////////////////////////////
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <bit>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <omp.h>
+
+#include "src/ThreeDModel.h"
+#include "src/RenderParameters.h"
+#include "src/Scene.h"
+#include "src/Raytracer.h"
+
+using namespace std;
+
+// best of this many runs is reported
+#define BENCH_REPEATS 3
+// scene builds timed, each from scratch
+#define BENCH_BUILDS 5
+// rays times triangles tested by each ray-triangle kernel
+#define BENCH_KERNEL_TESTS 20000000
+
+static const char *layoutNames[BVH_LAYOUT_COUNT] = {"binary", "wide", "compressed"};
+
+// the shading modes timed, as SHADE_* features
+static const int shadingModes[] = {
+    0,
+    SHADE_INTERPOLATION,
+    SHADE_PHONG,
+    SHADE_PHONG | SHADE_SHADOWS,
+    SHADE_PHONG | SHADE_REFLECTION,
+    SHADE_PHONG | SHADE_SHADOWS | SHADE_REFLECTION,
+    SHADE_PHONG | SHADE_REFRACTION,
+    SHADE_PHONG | SHADE_REFRACTION | SHADE_FRESNEL,
+    SHADE_PHONG | SHADE_SHADOWS | SHADE_REFLECTION | SHADE_REFRACTION,
+    SHADE_PHONG | SHADE_SHADOWS | SHADE_REFLECTION | SHADE_REFRACTION | SHADE_FRESNEL,
+};
+
+// the fixed cameras, the model stays where the window puts it
+struct BenchCamera{
+    const char *name;
+    Cartesian3 position;
+};
+static const BenchCamera cameras[] = {
+    {"front", Cartesian3(0.0f, 0.0f, 0.0f)},
+    {"close", Cartesian3(0.3f, 0.2f, 0.6f)},
+};
+
+// a small writer for the --json report, it keeps track of the commas
+class JsonWriter
+{
+public:
+    void beginObject(const char *key = nullptr) { prefix(key); out << "{"; first = true; }
+    void endObject() { out << "}"; first = false; }
+    void beginArray(const char *key = nullptr) { prefix(key); out << "["; first = true; }
+    void endArray() { out << "]"; first = false; }
+    void value(const char *key, double v) { prefix(key); out << v; }
+    void value(const char *key, long v) { prefix(key); out << v; }
+    void value(const char *key, int v) { prefix(key); out << v; }
+    void value(const char *key, const string &v)
+    {
+        prefix(key);
+        out << '"';
+        for (char c : v)
+        {
+            if (c == '"' || c == '\\')
+                out << '\\';
+            out << c;
+        }
+        out << '"';
+    }
+    string str() const { return out.str(); }
+
+private:
+    void prefix(const char *key)
+    {
+        if (!first)
+            out << ",";
+        first = false;
+        if (key)
+            out << '"' << key << "\":";
+    }
+    ostringstream out;
+    bool first = true;
+};
+
+// splits every triangle of the model in four, N times over, to get bigger meshes
+static void subdivide(ThreeDModel &model)
+{
+    vector<vector<unsigned int>> faceVertices, faceNormals, faceTexCoords;
+    auto midpoint = [](vector<Cartesian3> &list, unsigned int a, unsigned int b)
+    {
+        list.push_back((list[a] + list[b]) * 0.5f);
+        return (unsigned int)(list.size() - 1);
+    };
+
+    for (size_t face = 0; face < model.faceVertices.size(); face++)
+    {
+        for (size_t triangle = 0; triangle + 2 < model.faceVertices[face].size(); triangle++)
+        {
+            // the same fan triangulation as Mesh::addModel
+            unsigned int corner[3] = {0, (unsigned int)triangle + 1, (unsigned int)triangle + 2};
+            unsigned int v[6], n[6], t[6];
+            for (int i = 0; i < 3; i++)
+            {
+                v[i] = model.faceVertices[face][corner[i]];
+                n[i] = model.faceNormals[face][corner[i]];
+                t[i] = model.faceTexCoords[face][corner[i]];
+            }
+            for (int i = 0; i < 3; i++)
+            {
+                v[3 + i] = midpoint(model.vertices, v[i], v[(i + 1) % 3]);
+                n[3 + i] = midpoint(model.normals, n[i], n[(i + 1) % 3]);
+                t[3 + i] = midpoint(model.textureCoords, t[i], t[(i + 1) % 3]);
+            }
+            const int split[4][3] = {{0, 3, 5}, {3, 1, 4}, {5, 4, 2}, {3, 4, 5}};
+            for (int s = 0; s < 4; s++)
+            {
+                faceVertices.push_back({v[split[s][0]], v[split[s][1]], v[split[s][2]]});
+                faceNormals.push_back({n[split[s][0]], n[split[s][1]], n[split[s][2]]});
+                faceTexCoords.push_back({t[split[s][0]], t[split[s][1]], t[split[s][2]]});
+            }
+        }
+    }
+    model.faceVertices = faceVertices;
+    model.faceNormals = faceNormals;
+    model.faceTexCoords = faceTexCoords;
+}
+
+// bytes taken by the acceleration structures of the current layout
+static size_t structureBytes(const Scene &scene, int layout)
+{
+    auto bytes = [layout](const BVH &bvh, const WideBVH &wide, const CompressedBVH &compressed)
+    {
+        if (layout == BVH_LAYOUT_WIDE)
+            return wide.nodes.size() * sizeof(WideBVH::Node) + wide.primitiveIndices.size() * sizeof(int);
+        if (layout == BVH_LAYOUT_COMPRESSED)
+            return compressed.nodes.size() * sizeof(CompressedBVH::Node) + compressed.primitiveIndices.size() * sizeof(int);
+        return bvh.nodes.size() * sizeof(BVH::Node) + bvh.primitiveIndices.size() * sizeof(int);
+    };
+    size_t total = bytes(scene.topLevel, scene.wideTopLevel, scene.compressedTopLevel);
+    for (const Mesh &mesh : scene.meshes)
+        total += bytes(mesh.bvh, mesh.wideBvh, mesh.compressedBvh);
+    return total;
+}
+
+// traces every ray, returns the best Mrays/s and the number of hits
+static double traceRays(Scene &scene, const vector<Ray> &rays, long &hits)
+{
+    double best = 0.0;
+    for (int repeat = 0; repeat < BENCH_REPEATS; repeat++)
+    {
+        long count = 0;
+        auto start = chrono::steady_clock::now();
+        #pragma omp parallel for schedule(dynamic, 64) reduction(+:count)
+        for (int i = 0; i < int(rays.size()); i++)
+        {
+            if (scene.closestTriangle(rays[i]).t > 0.0f)
+                count++;
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        best = max(best, double(rays.size()) / seconds * 1e-6);
+        hits = count;
+    }
+    return best;
+}
+
+// ray-triangle tests per second of one thread with each kernel, every ray against every triangle.
+// sink keeps the compiler from dropping the work
+template <typename KernelFunction>
+static double kernelRate(const vector<Ray> &rays, int trianglesPerRay, float &sink, KernelFunction kernel)
+{
+    double best = 0.0;
+    for (int repeat = 0; repeat < BENCH_REPEATS; repeat++)
+    {
+        auto start = chrono::steady_clock::now();
+        for (const Ray &r : rays)
+            sink += kernel(r);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        best = max(best, double(rays.size()) * double(trianglesPerRay) / seconds * 1e-6);
+    }
+    return best;
+}
+
+static void benchKernels(Scene &scene, const vector<Ray> &primary, JsonWriter &json)
+{
+    vector<Triangle> triangles;
+    vector<WatertightTriangle> watertight;
+    vector<TrianglePacket> packets;
+    for (const Mesh &mesh : scene.meshes)
+        for (int i = 0; i < mesh.triangleCount(); i++)
+        {
+            Triangle triangle = mesh.triangle(i);
+            if (triangles.size() % TrianglePacket::width == 0)
+                packets.emplace_back();
+            packets.back().set(int(triangles.size() % TrianglePacket::width), mesh.position(i, 0), mesh.position(i, 1), mesh.position(i, 2), int(triangles.size()));
+            triangles.push_back(triangle);
+            watertight.push_back(WatertightTriangle(triangle));
+        }
+    if (triangles.empty())
+        return;
+
+    // the primary rays, thinned out to keep the run short. Kept in mesh space,
+    // the kernels are as fast whether a ray hits or not
+    vector<Ray> rays;
+    size_t rayCount = max(size_t(1), BENCH_KERNEL_TESTS / triangles.size());
+    for (size_t i = 0; i < primary.size() && rays.size() < rayCount; i += max(size_t(1), primary.size() / rayCount))
+        rays.push_back(primary[i]);
+
+    float sink = 0.0f;
+    int count = int(triangles.size());
+    double scalar = kernelRate(rays, count, sink, [&](const Ray &r)
+    {
+        Ray copy = r;
+        float hits = 0.0f;
+        for (Triangle &triangle : triangles)
+            hits += triangle.intersect(copy) > 0.0f;
+        return hits;
+    });
+    double single = kernelRate(rays, count, sink, [&](const Ray &r)
+    {
+        ShearedRay sheared(r);
+        float hits = 0.0f, t;
+        Cartesian3 bc;
+        for (const WatertightTriangle &triangle : watertight)
+            hits += triangle.intersect(sheared, t, bc);
+        return hits;
+    });
+    double packet = kernelRate(rays, count, sink, [&](const Ray &r)
+    {
+        ShearedRay sheared(r);
+        float hits = 0.0f;
+        float t[TrianglePacket::width], u[TrianglePacket::width], v[TrianglePacket::width], w[TrianglePacket::width];
+        for (const TrianglePacket &p : packets)
+            hits += float(popcount(unsigned(p.intersect(sheared, r.tMax, t, u, v, w))));
+        return hits;
+    });
+
+    cout << "ray-triangle kernels, " << rays.size() << " rays x " << count << " triangles on one thread (hits " << sink << "): Triangle::intersect "
+         << scalar << " Mtests/s, watertight " << single << " Mtests/s (x" << single / scalar << "), "
+         << TrianglePacket::width << "-wide packets " << packet << " Mtests/s (x" << packet / scalar << ")" << endl;
+
+    json.beginObject("triangleKernels");
+    json.value("rays", long(rays.size()));
+    json.value("triangles", count);
+    json.value("intersectMtests", scalar);
+    json.value("watertightMtests", single);
+    json.value("packetMtests", packet);
+    json.value("packetWidth", int(TrianglePacket::width));
+    json.endObject();
+}
+
+// Scene::updateScene on its own: building everything from scratch, a camera
+// move, which only redoes the top level, and one object's geometry changing
+static void benchBuild(vector<ThreeDModel> &objects, RenderParameters &renderParameters, JsonWriter &json)
+{
+    auto timed = [](auto &&work)
+    {
+        double best = 1e30;
+        for (int repeat = 0; repeat < BENCH_BUILDS; repeat++)
+        {
+            auto start = chrono::steady_clock::now();
+            work();
+            best = min(best, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    };
+
+    double full = timed([&]()
+    {
+        Scene scene(&objects, &renderParameters);
+        scene.updateScene();
+    });
+
+    Scene scene(&objects, &renderParameters);
+    scene.updateScene();
+    Cartesian3 camera = renderParameters.CameraPosition;
+    int move = 0;
+    double cameraMove = timed([&]()
+    {
+        renderParameters.CameraPosition = camera + Cartesian3(0.0f, 0.0f, 0.01f * float(++move));
+        scene.updateScene();
+    });
+    renderParameters.CameraPosition = camera;
+    double geometryChange = timed([&]()
+    {
+        objects[0].geometryChanged();
+        scene.updateScene();
+    });
+    scene.updateScene();
+
+    cout << "updateScene, best of " << BENCH_BUILDS << ": full build " << full << " ms, camera move " << cameraMove
+         << " ms, one object changed " << geometryChange << " ms" << endl;
+
+    json.beginObject("updateScene");
+    json.value("fullBuildMs", full);
+    json.value("cameraMoveMs", cameraMove);
+    json.value("geometryChangeMs", geometryChange);
+    json.endObject();
+}
+
+// Scene::closestTriangle throughput and size of every BVH layout
+static void benchLayouts(Scene &scene, RenderParameters &renderParameters, const vector<Ray> &primary, const vector<Ray> &secondary, JsonWriter &json)
+{
+    // everything is also given relative to the binary layout, which runs first
+    double binaryBytes = 0.0, binaryPrimary = 0.0, binarySecondary = 0.0;
+    json.beginArray("closestTriangle");
+    for (int layout = 0; layout < BVH_LAYOUT_COUNT; layout++)
+    {
+        renderParameters.bvhLayout = layout;
+        scene.updateScene();
+
+        long primaryHits = 0, secondaryHits = 0;
+        double bytes = double(structureBytes(scene, layout));
+        double primaryRate = traceRays(scene, primary, primaryHits);
+        double secondaryRate = traceRays(scene, secondary, secondaryHits);
+        if (layout == BVH_LAYOUT_BINARY)
+        {
+            binaryBytes = bytes;
+            binaryPrimary = primaryRate;
+            binarySecondary = secondaryRate;
+        }
+        cout << layoutNames[layout] << ": " << bytes / 1024.0 << " KiB (x" << bytes / binaryBytes << "), primary "
+             << primaryRate << " Mrays/s (x" << primaryRate / binaryPrimary << ", " << primaryHits << " hits), secondary "
+             << secondaryRate << " Mrays/s (x" << secondaryRate / binarySecondary << ", " << secondaryHits << " hits)" << endl;
+
+        json.beginObject();
+        json.value("layout", string(layoutNames[layout]));
+        json.value("bytes", bytes);
+        json.value("primaryMrays", primaryRate);
+        json.value("primaryHits", primaryHits);
+        json.value("secondaryMrays", secondaryRate);
+        json.value("secondaryHits", secondaryHits);
+        json.endObject();
+    }
+    json.endArray();
+    renderParameters.bvhLayout = BVH_LAYOUT_BINARY;
+    scene.updateScene();
+}
+
+// whole frames from the fixed cameras with each feature set, and the rays they took
+static void benchRenders(vector<ThreeDModel> &objects, RenderParameters &renderParameters, int width, int height, JsonWriter &json)
+{
+    Raytracer raytracer(&objects, &renderParameters);
+    raytracer.resize(width, height);
+    Cartesian3 camera = renderParameters.CameraPosition;
+
+    json.beginArray("renders");
+    for (const BenchCamera &view : cameras)
+    {
+        renderParameters.CameraPosition = view.position;
+        for (int features : RenderParameters::shadingPresets)
+        {
+            renderParameters.setShadingFeatures(features);
+            double milliseconds = 1e30;
+            RenderStats stats;
+            for (int repeat = 0; repeat < BENCH_REPEATS; repeat++)
+            {
+                auto start = chrono::steady_clock::now();
+                raytracer.RaytraceBlocking();
+                milliseconds = min(milliseconds, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+                // the same every time, the frame is the same
+                stats = raytracer.frameStats();
+            }
+            // rays of each kind per second of the whole frame
+            double perSecond = 1e-3 / milliseconds;
+            cout << "render " << view.name << " " << RenderParameters::shadingFeatureName(features) << ": " << milliseconds << " ms, primary "
+                 << double(stats.primaryRays) * perSecond << " Mrays/s, secondary " << double(stats.secondaryRays) * perSecond
+                 << " Mrays/s, shadow " << double(stats.shadowRays) * perSecond << " Mrays/s ("
+                 << stats.primaryRays << "/" << stats.secondaryRays << "/" << stats.shadowRays << " rays)" << endl;
+
+            json.beginObject();
+            json.value("camera", string(view.name));
+            json.value("features", RenderParameters::shadingFeatureName(features));
+            json.value("ms", milliseconds);
+            json.value("primaryRays", stats.primaryRays);
+            json.value("secondaryRays", stats.secondaryRays);
+            json.value("shadowRays", stats.shadowRays);
+            json.value("primaryMrays", double(stats.primaryRays) * perSecond);
+            json.value("secondaryMrays", double(stats.secondaryRays) * perSecond);
+            json.value("shadowMrays", double(stats.shadowRays) * perSecond);
+            json.value("nodesVisited", stats.nodesVisited);
+            json.value("triangleTests", stats.triangleTests);
+            json.value("maxDepth", stats.maxDepth);
+            json.endObject();
+        }
+    }
+    json.endArray();
+    renderParameters.CameraPosition = camera;
+    renderParameters.setShadingFeatures(0);
+}
+
+// frame times of each shading mode, with the kernel compiled for it and with the generic one
+static void benchShading(vector<ThreeDModel> &objects, RenderParameters &renderParameters, int width, int height, JsonWriter &json)
+{
+    renderParameters.bvhLayout = BVH_LAYOUT_BINARY;
+    Raytracer raytracer(&objects, &renderParameters);
+    raytracer.resize(width, height);
+
+    json.beginArray("shadingKernels");
+    for (int features : shadingModes)
+    {
+        renderParameters.setShadingFeatures(features);
+
+        // the generic kernel first, then the one for these flags
+        double milliseconds[2];
+        for (int specialized = 0; specialized < 2; specialized++)
+        {
+            renderParameters.specializedShading = specialized;
+            milliseconds[specialized] = 1e30;
+            for (int repeat = 0; repeat < BENCH_REPEATS; repeat++)
+            {
+                auto start = chrono::steady_clock::now();
+                raytracer.RaytraceBlocking();
+                milliseconds[specialized] = min(milliseconds[specialized], chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+            }
+        }
+        cout << "shading " << RenderParameters::shadingFeatureName(features) << ": generic " << milliseconds[0] << " ms, specialized " << milliseconds[1]
+             << " ms (x" << milliseconds[0] / milliseconds[1] << ")" << endl;
+
+        json.beginObject();
+        json.value("features", RenderParameters::shadingFeatureName(features));
+        json.value("genericMs", milliseconds[0]);
+        json.value("specializedMs", milliseconds[1]);
+        json.endObject();
+    }
+    json.endArray();
+    renderParameters.specializedShading = true;
+    renderParameters.setShadingFeatures(0);
+}
+
+// everything for one scene, false if it could not be read
+static bool benchScene(const string &geometry, const string &material, int subdivisions, int width, int height,
+                       int renderWidth, int renderHeight, JsonWriter &json)
+{
+    auto loadStart = chrono::steady_clock::now();
+    ifstream geometryFile(geometry);
+    ifstream materialFile(material);
+    if (!geometryFile.good() || !materialFile.good())
+    {
+        cout << "Read failed for object " << geometry << " or material " << material << endl;
+        return false;
+    }
+    vector<ThreeDModel> objects = ThreeDModel::ReadObjectStreamMaterial(geometryFile, materialFile);
+    if (objects.empty())
+    {
+        cout << "Read failed for object " << geometry << " or material " << material << endl;
+        return false;
+    }
+    for (int s = 0; s < subdivisions; s++)
+        for (ThreeDModel &object : objects)
+            subdivide(object);
+    double loadTime = chrono::duration<double, milli>(chrono::steady_clock::now() - loadStart).count();
+
+    RenderParameters renderParameters;
+    renderParameters.findLights(objects);
+    // the frames are timed whole, without the coarse passes the window shows first
+    renderParameters.progressiveRendering = false;
+    Scene scene(&objects, &renderParameters);
+    scene.updateScene();
+
+    // camera rays, set up like Raytracer::calculateRay
+    vector<Ray> primary;
+    float aspect = float(width) / float(height);
+    float fovFactor = tanf(renderParameters.fov / 2);
+    for (int j = 0; j < height; j++)
+        for (int i = 0; i < width; i++)
+        {
+            float x = (i / float(width) - 0.5f) * 2 * aspect * fovFactor;
+            float y = (j / float(height) - 0.5f) * 2 * fovFactor;
+            primary.push_back(scene.fromCamera(Ray(Cartesian3(0, 0, 0), Cartesian3(x, y, 1), Ray::primary)));
+        }
+
+    // incoherent rays, leaving the primary hits in random directions
+    vector<Ray> secondary;
+    mt19937 generator(5892);
+    normal_distribution<float> gaussian;
+    for (const Ray &r : primary)
+    {
+        Scene::CollisionInfo ci = scene.closestTriangle(r);
+        if (ci.t <= 0.0f)
+            continue;
+        Cartesian3 direction(gaussian(generator), gaussian(generator), gaussian(generator));
+        Cartesian3 origin = r.origin + r.direction * (ci.t * 0.999f);
+        secondary.push_back(Ray(origin, direction.unit(), Ray::secondary));
+    }
+
+    long triangles = 0;
+    for (const Mesh &mesh : scene.meshes)
+        triangles += mesh.triangleCount();
+    cout << endl << geometry << ", " << subdivisions << " subdivisions, " << triangles << " triangles, loaded in " << loadTime
+         << " ms, " << primary.size() << " primary and " << secondary.size() << " secondary rays on " << omp_get_max_threads() << " threads" << endl;
+
+    // what the queries read, against what only the hits read, and what the
+    // cold data would take as one Triangle each
+    double hotBytes = 0.0, coldBytes = 0.0, expandedBytes = 0.0;
+    for (const Mesh &mesh : scene.meshes)
+    {
+        hotBytes += double(mesh.packets.size() * sizeof(TrianglePacket) + mesh.laneMasks.size() + mesh.shadowMasks.size());
+        coldBytes += double((mesh.positions.size() + mesh.normals.size() + mesh.uvs.size()) * sizeof(Cartesian3) + mesh.indices.size() * sizeof(unsigned int));
+        expandedBytes += double(mesh.triangleCount() * sizeof(Triangle));
+    }
+    cout << "triangle data: hot " << hotBytes / 1024.0 << " KiB, cold " << coldBytes / 1024.0 << " KiB indexed ("
+         << expandedBytes / 1024.0 << " KiB as Triangles)" << endl;
+
+    json.beginObject();
+    json.value("geometry", geometry);
+    json.value("material", material);
+    json.value("subdivisions", subdivisions);
+    json.value("triangles", triangles);
+    json.value("loadMs", loadTime);
+    json.value("hotBytes", hotBytes);
+    json.value("coldBytes", coldBytes);
+
+    benchBuild(objects, renderParameters, json);
+    benchLayouts(scene, renderParameters, primary, secondary, json);
+    benchKernels(scene, primary, json);
+    cout << "frames, " << renderWidth << "x" << renderHeight << ":" << endl;
+    benchRenders(objects, renderParameters, renderWidth, renderHeight, json);
+    benchShading(objects, renderParameters, renderWidth, renderHeight, json);
+    json.endObject();
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    vector<pair<string, string>> scenes;
+    string geometry, material;
+    string jsonPath;
+    int subdivisions = 0;
+    int width = 512, height = 512;
+    int renderWidth = 256, renderHeight = 256;
+
+    int positional = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--subdivide") && i + 1 < argc)
+            subdivisions = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--size") && i + 2 < argc)
+        {
+            width = atoi(argv[++i]);
+            height = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--render-size") && i + 2 < argc)
+        {
+            renderWidth = atoi(argv[++i]);
+            renderHeight = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--json") && i + 1 < argc)
+            jsonPath = argv[++i];
+        else if (positional == 0 && argv[i][0] != '-')
+        {
+            geometry = argv[i];
+            positional++;
+        }
+        else if (positional == 1 && argv[i][0] != '-')
+        {
+            material = argv[i];
+            positional++;
+        }
+        else
+        {
+            cout << "Usage: " << argv[0] << " [geometry material] [--subdivide N] [--size W H] [--render-size W H] [--json FILE]" << endl;
+            return 1;
+        }
+    }
+    if (width <= 0 || height <= 0 || renderWidth <= 0 || renderHeight <= 0)
+    {
+        cout << "Bad resolution" << endl;
+        return 1;
+    }
+
+    // every .obj in objects/ that has its .mtl, unless one scene is given
+    if (positional == 2)
+        scenes.push_back({geometry, material});
+    else if (positional == 0)
+    {
+        error_code error;
+        for (const auto &entry : filesystem::directory_iterator("objects", error))
+        {
+            filesystem::path path = entry.path();
+            if (path.extension() != ".obj")
+                continue;
+            filesystem::path mtl = path;
+            mtl.replace_extension(".mtl");
+            if (filesystem::exists(mtl))
+                scenes.push_back({path.generic_string(), mtl.generic_string()});
+        }
+        sort(scenes.begin(), scenes.end());
+        if (scenes.empty())
+        {
+            cout << "No scenes found in objects/, run from the repository root" << endl;
+            return 1;
+        }
+    }
+    else
+    {
+        cout << "Both a geometry and a material file are needed" << endl;
+        return 1;
+    }
+
+    JsonWriter json;
+    json.beginObject();
+    json.value("threads", omp_get_max_threads());
+    json.beginObject("size");
+    json.value("width", width);
+    json.value("height", height);
+    json.endObject();
+    json.beginObject("renderSize");
+    json.value("width", renderWidth);
+    json.value("height", renderHeight);
+    json.endObject();
+    json.value("repeats", BENCH_REPEATS);
+    json.beginArray("scenes");
+    int failed = 0;
+    for (const auto &entry : scenes)
+        if (!benchScene(entry.first, entry.second, subdivisions, width, height, renderWidth, renderHeight, json))
+            failed++;
+    json.endArray();
+    json.endObject();
+
+    if (!jsonPath.empty())
+    {
+        ofstream jsonFile(jsonPath);
+        if (!jsonFile.good())
+        {
+            cout << "Could not write " << jsonPath << endl;
+            return 1;
+        }
+        jsonFile << json.str() << endl;
+        cout << endl << "Wrote " << jsonPath << endl;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,258 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  University of Leeds
+//  COMP 5892M Advanced Rendering
+//  User Interface for Coursework
+//
+//  ------------------------
+//  headless.cpp
+//  ------------------------
+//
+//  Renders one image with the Raytracer and writes it out, with no window
+//  and no OpenGL, for batch jobs and reproducible timings. The flags are
+//  those of the keys in the window, all off unless given. Run from the
+//  repository root:
+//      headless geometry material [options]
+//
+///////////////////////////////////////////////////
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <omp.h>
+
+#include "src/ThreeDModel.h"
+#include "src/RenderParameters.h"
+#include "src/Raytracer.h"
+#include "src/TraceRecorder.h"
+
+using namespace std;
+
+static void usage(const char *program)
+{
+    cout << "Usage: " << program << " geometry material [options]" << endl
+         << "  --output FILE          image to write, a PPM (default render.ppm)" << endl
+         << "  --size W H             resolution (default 960 1080, the raytraced half of the window)" << endl
+         << "  --camera X Y Z         camera position (default 0 0 0)" << endl
+         << "  --camera-rotation X Y Z W   camera rotation as a quaternion (default 0 0 0 1)" << endl
+         << "  --model X Y Z          model position (default 0 0 2)" << endl
+         << "  --model-rotation X Y Z W    model rotation as a quaternion (default 0 1 0 0)" << endl
+         << "  --fov DEGREES          vertical field of view (default 80)" << endl
+         << "  --ortho                orthographic projection" << endl
+         << "  --interpolation --phong --shadows --reflection --refraction --fresnel" << endl
+         << "                         shading features, as keys 1 to 6 in the window" << endl
+         << "  --no-bvh               test every triangle" << endl
+         << "  --layout binary|wide|compressed   BVH node layout (default binary)" << endl
+         << "  --world-space          trace in world space instead of VCS" << endl
+         << "  --generic              the generic shading kernel instead of the specialised one" << endl
+         << "  --progressive          render in coarse to fine passes" << endl
+         << "  --heatmap nodes|tests  colour the pixels by the BVH nodes visited or the triangles tested" << endl
+         << "  --repeat N             render N times and report the best time (default 1)" << endl
+         << "  --stats FILE           print the rays and traversal work of the frame, and write them to FILE as JSON" << endl
+         << "  --trace FILE           write a timeline of the threads to FILE, for chrome://tracing or Perfetto" << endl;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3 || argv[1][0] == '-' || argv[2][0] == '-')
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    RenderParameters renderParameters;
+    // the window would show the first image at once, here only the last counts
+    renderParameters.progressiveRendering = false;
+    string output = "render.ppm";
+    string statsOutput;
+    string traceOutput;
+    int width = 960, height = 1080;
+    int repeats = 1;
+
+    for (int i = 3; i < argc; i++)
+    {
+        // how many values are left after the option
+        int left = argc - i - 1;
+        if (!strcmp(argv[i], "--output") && left >= 1)
+            output = argv[++i];
+        else if (!strcmp(argv[i], "--size") && left >= 2)
+        {
+            width = atoi(argv[++i]);
+            height = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--camera") && left >= 3)
+        {
+            float x = float(atof(argv[++i])), y = float(atof(argv[++i])), z = float(atof(argv[++i]));
+            renderParameters.CameraPosition = Cartesian3(x, y, z);
+        }
+        else if (!strcmp(argv[i], "--camera-rotation") && left >= 4)
+        {
+            float x = float(atof(argv[++i])), y = float(atof(argv[++i])), z = float(atof(argv[++i])), w = float(atof(argv[++i]));
+            renderParameters.CameraArcball = ArcBall(Quaternion(x, y, z, w));
+        }
+        else if (!strcmp(argv[i], "--model") && left >= 3)
+        {
+            float x = float(atof(argv[++i])), y = float(atof(argv[++i])), z = float(atof(argv[++i]));
+            renderParameters.ModelPosition = Cartesian3(x, y, z);
+        }
+        else if (!strcmp(argv[i], "--model-rotation") && left >= 4)
+        {
+            float x = float(atof(argv[++i])), y = float(atof(argv[++i])), z = float(atof(argv[++i])), w = float(atof(argv[++i]));
+            renderParameters.ModelArcball = ArcBall(Quaternion(x, y, z, w));
+        }
+        else if (!strcmp(argv[i], "--fov") && left >= 1)
+            renderParameters.fov = float(atof(argv[++i])) * (std::numbers::pi_v<float> / 180.0f);
+        else if (!strcmp(argv[i], "--ortho"))
+            renderParameters.orthoProjection = true;
+        else if (!strcmp(argv[i], "--interpolation"))
+            renderParameters.interpolationRendering = true;
+        else if (!strcmp(argv[i], "--phong"))
+            renderParameters.phongEnabled = true;
+        else if (!strcmp(argv[i], "--shadows"))
+            renderParameters.shadowsEnabled = true;
+        else if (!strcmp(argv[i], "--reflection"))
+            renderParameters.reflectionEnabled = true;
+        else if (!strcmp(argv[i], "--refraction"))
+            renderParameters.refractionEnabled = true;
+        else if (!strcmp(argv[i], "--fresnel"))
+            renderParameters.fresnelRendering = true;
+        else if (!strcmp(argv[i], "--no-bvh"))
+            renderParameters.bvhEnabled = false;
+        else if (!strcmp(argv[i], "--layout") && left >= 1)
+        {
+            string layout = argv[++i];
+            if (layout == "binary")
+                renderParameters.bvhLayout = BVH_LAYOUT_BINARY;
+            else if (layout == "wide")
+                renderParameters.bvhLayout = BVH_LAYOUT_WIDE;
+            else if (layout == "compressed")
+                renderParameters.bvhLayout = BVH_LAYOUT_COMPRESSED;
+            else
+            {
+                cout << "Unknown BVH layout " << layout << endl;
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--world-space"))
+            renderParameters.worldSpaceRendering = true;
+        else if (!strcmp(argv[i], "--generic"))
+            renderParameters.specializedShading = false;
+        else if (!strcmp(argv[i], "--progressive"))
+            renderParameters.progressiveRendering = true;
+        else if (!strcmp(argv[i], "--heatmap") && left >= 1)
+        {
+            string heatmap = argv[++i];
+            if (heatmap == "nodes")
+                renderParameters.heatmapMode = HEATMAP_NODES;
+            else if (heatmap == "tests")
+                renderParameters.heatmapMode = HEATMAP_TESTS;
+            else
+            {
+                cout << "Unknown heatmap " << heatmap << endl;
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--repeat") && left >= 1)
+            repeats = max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--stats") && left >= 1)
+            statsOutput = argv[++i];
+        else if (!strcmp(argv[i], "--trace") && left >= 1)
+            traceOutput = argv[++i];
+        else
+        {
+            cout << "Unknown or incomplete option " << argv[i] << endl;
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (width <= 0 || height <= 0)
+    {
+        cout << "Bad resolution " << width << "x" << height << endl;
+        return 1;
+    }
+
+    auto loadStart = chrono::steady_clock::now();
+    ifstream geometryFile(argv[1]);
+    ifstream materialFile(argv[2]);
+    if (!geometryFile.good() || !materialFile.good())
+    {
+        cout << "Read failed for object " << argv[1] << " or material " << argv[2] << endl;
+        return 1;
+    }
+    vector<ThreeDModel> objects = ThreeDModel::ReadObjectStreamMaterial(geometryFile, materialFile);
+    if (objects.empty())
+    {
+        cout << "Read failed for object " << argv[1] << " or material " << argv[2] << endl;
+        return 1;
+    }
+    renderParameters.findLights(objects);
+    double loadTime = chrono::duration<double, milli>(chrono::steady_clock::now() - loadStart).count();
+    cout << "Loaded " << argv[1] << " in " << loadTime << " ms" << endl;
+
+    if (!traceOutput.empty())
+    {
+        renderParameters.tracingEnabled = true;
+        TraceRecorder::nameThread("main");
+        TraceRecorder::start();
+    }
+    renderParameters.printSettings();
+    Raytracer raytracer(&objects, &renderParameters);
+    raytracer.resize(width, height);
+
+    // the first frame also builds the meshes and their BVHs
+    double first = 0.0, best = 0.0;
+    for (int repeat = 0; repeat < repeats; repeat++)
+    {
+        auto start = chrono::steady_clock::now();
+        raytracer.RaytraceBlocking();
+        double time = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        if (repeat == 0)
+            first = best = time;
+        best = min(best, time);
+    }
+    TraceRecorder::stop();
+    cout << "Rendered " << width << "x" << height << " on " << omp_get_max_threads() << " threads: first frame "
+         << first << " ms, best of " << repeats << " " << best << " ms (" << double(width) * double(height) / best * 1e-3
+         << " Mpixels/s)" << endl;
+
+    ofstream outputFile(output);
+    if (!outputFile.good())
+    {
+        cout << "Could not write " << output << endl;
+        return 1;
+    }
+    raytracer.frameBuffer.WritePPM(outputFile);
+    cout << "Wrote " << output << endl;
+
+    if (!statsOutput.empty())
+    {
+        raytracer.frameStats().print(cout);
+        ofstream statsFile(statsOutput);
+        if (!statsFile.good())
+        {
+            cout << "Could not write " << statsOutput << endl;
+            return 1;
+        }
+        RenderStats::writeJson(statsFile, raytracer.threadStats());
+        statsFile << endl;
+        cout << "Wrote " << statsOutput << endl;
+    }
+
+    if (!traceOutput.empty())
+    {
+        ofstream traceFile(traceOutput);
+        if (!traceFile.good())
+        {
+            cout << "Could not write " << traceOutput << endl;
+            return 1;
+        }
+        TraceRecorder::writeJson(traceFile);
+        cout << "Wrote " << traceOutput << endl;
+    }
+    return 0;
+}
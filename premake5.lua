@@ -94,5 +94,73 @@ project "main"
 
 	includedirs( "." );
 
+-- Ray query benchmarks, no window and no OpenGL
+project "bench"
+	local sources = { 
+		"bench/**.cpp",
+		"src/**.cpp",
+		"src/**.h",
+	}
+
+	kind "ConsoleApp"
+	location "bench"
+	
+	openmp "on"
+
+	files( sources )
+	removefiles "src/main.cpp"
+	removelinks { "GL", "GLX" }
+
+	includedirs( "." );
+
+
+-- Batch rendering from the command line, no window and no OpenGL
+project "headless"
+	local sources = { 
+		"headless/**.cpp",
+		"src/**.cpp",
+		"src/**.h",
+	}
+
+	kind "ConsoleApp"
+	location "headless"
+	
+	openmp "on"
+
+	files( sources )
+	removefiles "src/main.cpp"
+	removelinks { "GL", "GLX" }
+
+	includedirs( "." );
+
+
+-- Golden image tests against regression/references, no window and no OpenGL
+project "regression"
+	local sources = { 
+		"regression/**.cpp",
+		"src/**.cpp",
+		"src/**.h",
+	}
+
+	kind "ConsoleApp"
+	location "regression"
+	
+	openmp "on"
+
+	files( sources )
+	removefiles "src/main.cpp"
+	removelinks { "GL", "GLX" }
+
+	includedirs( "." );
+
+	-- The images have to come out the same whichever machine builds them:
+	-- a fixed instruction set instead of the host's, and plain IEEE
+	-- arithmetic, without -ffast-math or contracted multiply-adds, so that
+	-- the compiler cannot round differently from one inlining to the next
+	filter "toolset:gcc or toolset:clang"
+		removebuildoptions { "-march=native", "-ffast-math" }
+		buildoptions { "-march=x86-64-v3", "-ffp-contract=off" }
+
+	filter "*"
 
 --EOF
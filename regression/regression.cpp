@@ -0,0 +1,362 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  University of Leeds
+//  COMP 5892M Advanced Rendering
+//  User Interface for Coursework
+//
+//  ------------------------
+//  regression.cpp
+//  ------------------------
+//
+//  Golden image tests. Renders every scene in objects/ with a few fixed
+//  sets of shading flags, at a small size, and compares each image to the
+//  reference stored in regression/references/. Every image is rendered
+//  with each BVH layout, without the BVH, and in world space, each with
+//  the specialised and the generic kernel. This target is built without
+//  -march=native and -ffast-math (see premake5.lua), so the images do not
+//  depend on the machine or the build configuration that made them, and
+//  the references are renders of this tree in that build. An image fails
+//  when its PSNR falls below the threshold, or when more than a few
+//  pixels are further off than the max error. The render and an amplified
+//  difference of every failure go to regression/diffs/. Before the
+//  images, the shadow rays from a grid of hits in each scene are checked
+//  against the closest hit, with every BVH layout, without the BVH and in
+//  world space: occluded has to shadow exactly the points the closest hit
+//  would. Returns 1 if anything failed. Run from the repository root:
+//      regression [--update] [--size W H] [--psnr DB] [--max-error N] [--outliers N]
+//  --update writes this tree's images as the references instead, after a
+//  change that is meant to change the images.
+//
+///////////////////////////////////////////////////
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <filesystem>
+#include <algorithm>
+
+#include "src/ThreeDModel.h"
+#include "src/RenderParameters.h"
+#include "src/Raytracer.h"
+
+using namespace std;
+
+#define REFERENCE_DIRECTORY "regression/references"
+#define DIFF_DIRECTORY "regression/diffs"
+// an image fails below this PSNR, in dB over the 8 bit channels. The
+// images match their references exactly, so a shadow that moves across a
+// few pixels already fails
+#define REGRESSION_MIN_PSNR 60.0
+// or with too many pixels that have a channel further off than this
+#define REGRESSION_MAX_ERROR 16
+// the number of pixels that may be. Paths through glass are chaotic: a
+// math library may round a last bit differently, which can send a ray that
+// grazes an edge somewhere else and change its pixel completely. It is a
+// count, not a share of the image, so that a lost shadow edge or an open
+// seam fails even in the small images
+#define REGRESSION_OUTLIERS 2
+// differences are scaled up this much in the diff images
+#define DIFF_SCALE 8
+// the occlusion check follows a camera ray through this many times as many
+// points as the images have pixels, in each direction, the pixels among them
+#define OCCLUSION_GRID_SCALE 4
+// shadow rays leave this far off the surface, and end this far short of the light
+#define SHADOW_EPSILON 0.01f
+
+// the ways of finding the hits every image is rendered with. They only
+// change the work done, so each one has to give the reference image
+struct Traversal{
+    const char *name;
+    bool bvh;
+    int layout;
+    bool worldSpace;
+};
+static const Traversal traversals[] = {
+    {"binary", true, BVH_LAYOUT_BINARY, false},
+    {"wide", true, BVH_LAYOUT_WIDE, false},
+    {"compressed", true, BVH_LAYOUT_COMPRESSED, false},
+    {"linear", false, BVH_LAYOUT_BINARY, false},
+    {"world", true, BVH_LAYOUT_BINARY, true},
+};
+
+// how far one image is from another
+struct ImageError{
+    double psnr;
+    int maxError;
+    // pixels with a channel off by more than the threshold
+    int outliers;
+};
+
+static ImageError compare(RGBAImage &image, RGBAImage &reference, RGBAImage &diff, int threshold)
+{
+    double squares = 0.0;
+    int maxError = 0, outliers = 0;
+    diff.Resize(image.width, image.height);
+    for (int row = 0; row < image.height; row++)
+        for (int col = 0; col < image.width; col++)
+        {
+            RGBAValue a = image[row][col], b = reference[row][col];
+            int error[3] = {abs(int(a.red) - int(b.red)), abs(int(a.green) - int(b.green)), abs(int(a.blue) - int(b.blue))};
+            int pixelError = max({error[0], error[1], error[2]});
+            for (int c = 0; c < 3; c++)
+                squares += double(error[c]) * double(error[c]);
+            maxError = max(maxError, pixelError);
+            if (pixelError > threshold)
+                outliers++;
+            diff[row][col] = RGBAValue((unsigned char)min(255, error[0] * DIFF_SCALE), (unsigned char)min(255, error[1] * DIFF_SCALE),
+                                       (unsigned char)min(255, error[2] * DIFF_SCALE), (unsigned char)255);
+        }
+    double mse = squares / (3.0 * double(image.width) * double(image.height));
+    // identical images have no noise at all, which is as good as it gets
+    double psnr = mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 1e9;
+    return {psnr, maxError, outliers};
+}
+
+// shadow rays from the hits of a grid of camera rays towards every light. A
+// point is in shadow when something that is not a light lies between it and
+// the light. Each shadow ray has to run from just above the point to just
+// short of the light, and occluded has to give it the same answer as walking
+// the closest hits along it. Returns the rays that do not
+static int occlusionMismatches(Scene &scene, float fov, int width, int height, long &rays)
+{
+    float aspect = float(width) / float(height);
+    float fovFactor = tanf(fov / 2.0f);
+    int mismatches = 0;
+    for (int j = 0; j < height; j++)
+        for (int i = 0; i < width; i++)
+        {
+            // through the pixel corners, like the camera rays of the renderer
+            float x = (float(i) / float(width) - 0.5f) * 2.0f * aspect * fovFactor;
+            float y = (float(j) / float(height) - 0.5f) * 2.0f * fovFactor;
+            Ray cameraRay = scene.fromCamera(Ray(Cartesian3(0.0f, 0.0f, 0.0f), Cartesian3(x, y, 1.0f), Ray::primary));
+            Scene::CollisionInfo hit = scene.closestTriangle(cameraRay);
+            if (hit.t <= 0.0f)
+                continue;
+            Cartesian3 point = scene.hitPoint(hit);
+            Cartesian3 normal = scene.hitNormal(hit).unit();
+            for (const Scene::SceneLight &light : scene.lights)
+            {
+                Ray shadowRay = scene.shadowRay(point, normal, light);
+                Cartesian3 origin = point + SHADOW_EPSILON * normal;
+                float distance = (light.point - origin).length();
+                bool endsAtLight = (shadowRay.origin - origin).length() <= 1e-5f * max(1.0f, origin.length()) &&
+                                   (shadowRay.direction - (light.point - origin).unit()).length() <= 1e-5f &&
+                                   fabs(shadowRay.tMax - (distance - SHADOW_EPSILON)) <= 1e-5f * max(1.0f, distance);
+                // past the lights in front, up to the first thing that is not one
+                bool shadowed = false;
+                Ray walk = shadowRay;
+                for (Scene::CollisionInfo closest = scene.closestTriangle(walk); closest.t > 0.0f; closest = scene.closestTriangle(walk))
+                {
+                    if (!scene.hitMaterial(closest)->isLight())
+                    {
+                        shadowed = true;
+                        break;
+                    }
+                    walk.tMin = closest.t;
+                }
+                rays++;
+                if (!endsAtLight || scene.occluded(shadowRay) != shadowed)
+                    mismatches++;
+            }
+        }
+    return mismatches;
+}
+
+static bool writeImage(const string &path, RGBAImage &image)
+{
+    ofstream file(path);
+    if (!file.good())
+        return false;
+    image.WritePPM(file);
+    return file.good();
+}
+
+int main(int argc, char **argv)
+{
+    bool update = false;
+    int width = 48, height = 36;
+    double minPsnr = REGRESSION_MIN_PSNR;
+    int maxError = REGRESSION_MAX_ERROR;
+    int allowedOutliers = REGRESSION_OUTLIERS;
+
+    for (int i = 1; i < argc; i++)
+    {
+        int left = argc - i - 1;
+        if (!strcmp(argv[i], "--update"))
+            update = true;
+        else if (!strcmp(argv[i], "--size") && left >= 2)
+        {
+            width = atoi(argv[++i]);
+            height = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--psnr") && left >= 1)
+            minPsnr = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--max-error") && left >= 1)
+            maxError = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--outliers") && left >= 1)
+            allowedOutliers = atoi(argv[++i]);
+        else
+        {
+            cout << "Usage: " << argv[0] << " [--update] [--size W H] [--psnr DB] [--max-error N] [--outliers N]" << endl;
+            return 1;
+        }
+    }
+    if (width <= 0 || height <= 0)
+    {
+        cout << "Bad resolution " << width << "x" << height << endl;
+        return 1;
+    }
+
+    // every .obj in objects/ that has its .mtl
+    vector<filesystem::path> scenes;
+    error_code error;
+    for (const auto &entry : filesystem::directory_iterator("objects", error))
+    {
+        filesystem::path path = entry.path();
+        filesystem::path mtl = path;
+        mtl.replace_extension(".mtl");
+        if (path.extension() == ".obj" && filesystem::exists(mtl))
+            scenes.push_back(path);
+    }
+    sort(scenes.begin(), scenes.end());
+    if (scenes.empty())
+    {
+        cout << "No scenes found in objects/, run from the repository root" << endl;
+        return 1;
+    }
+    filesystem::create_directories(update ? REFERENCE_DIRECTORY : DIFF_DIRECTORY, error);
+
+    int checked = 0;
+    vector<string> failures;
+    for (const filesystem::path &scene : scenes)
+    {
+        filesystem::path material = scene;
+        material.replace_extension(".mtl");
+        ifstream geometryFile(scene);
+        ifstream materialFile(material);
+        vector<ThreeDModel> objects = ThreeDModel::ReadObjectStreamMaterial(geometryFile, materialFile);
+        if (objects.empty())
+        {
+            cout << "FAIL " << scene.generic_string() << ": could not be read" << endl;
+            failures.push_back(scene.generic_string());
+            continue;
+        }
+
+        RenderParameters renderParameters;
+        renderParameters.findLights(objects);
+        // only the finished image counts
+        renderParameters.progressiveRendering = false;
+
+        // the shadow rays have to agree with the closest hit, whichever way it is found
+        for (const Traversal &traversal : traversals)
+        {
+            if (update)
+                break;
+            renderParameters.bvhEnabled = traversal.bvh;
+            renderParameters.bvhLayout = traversal.layout;
+            renderParameters.worldSpaceRendering = traversal.worldSpace;
+            Scene shadowScene(&objects, &renderParameters);
+            shadowScene.updateScene();
+            long rays = 0;
+            int mismatches = occlusionMismatches(shadowScene, renderParameters.fov, OCCLUSION_GRID_SCALE * width, OCCLUSION_GRID_SCALE * height, rays);
+            string label = "occlusion " + scene.stem().string() + " (" + traversal.name + ")";
+            checked++;
+            if (mismatches == 0)
+            {
+                cout << "ok   " << label << ": " << rays << " shadow rays agree with the closest hit" << endl;
+                continue;
+            }
+            cout << "FAIL " << label << ": " << mismatches << " of " << rays << " shadow rays disagree with the closest hit" << endl;
+            failures.push_back(label);
+        }
+        Raytracer raytracer(&objects, &renderParameters);
+        raytracer.resize(width, height);
+
+        for (int features : RenderParameters::shadingPresets)
+        {
+            renderParameters.setShadingFeatures(features);
+            string name = scene.stem().string() + "_" + RenderParameters::shadingFeatureName(features);
+            string referencePath = string(REFERENCE_DIRECTORY) + "/" + name + ".ppm";
+
+            if (update)
+            {
+                const Traversal &traversal = traversals[0];
+                renderParameters.bvhEnabled = traversal.bvh;
+                renderParameters.bvhLayout = traversal.layout;
+                renderParameters.worldSpaceRendering = traversal.worldSpace;
+                renderParameters.specializedShading = true;
+                raytracer.RaytraceBlocking();
+                if (!writeImage(referencePath, raytracer.frameBuffer))
+                {
+                    cout << "Could not write " << referencePath << endl;
+                    return 1;
+                }
+                cout << "Wrote " << referencePath << endl;
+                continue;
+            }
+
+            RGBAImage reference;
+            ifstream referenceFile(referencePath);
+            if (!referenceFile.good() || !reference.ReadPPM(referenceFile) || reference.width != width || reference.height != height)
+            {
+                cout << "FAIL " << name << ": no " << width << "x" << height << " reference in " << referencePath
+                     << ", run with --update to make one" << endl;
+                failures.push_back(name);
+                continue;
+            }
+
+            // every traversal, with both kernels, has to give the reference image
+            for (const Traversal &traversal : traversals)
+            {
+                renderParameters.bvhEnabled = traversal.bvh;
+                renderParameters.bvhLayout = traversal.layout;
+                renderParameters.worldSpaceRendering = traversal.worldSpace;
+                for (int specialized = 1; specialized >= 0; specialized--)
+                {
+                    renderParameters.specializedShading = specialized;
+                    raytracer.RaytraceBlocking();
+                    RGBAImage diff;
+                    ImageError imageError = compare(raytracer.frameBuffer, reference, diff, maxError);
+                    string kernel = specialized ? "specialized" : "generic";
+                    string label = name + " (" + traversal.name + ", " + kernel + ")";
+                    bool passed = imageError.psnr >= minPsnr && imageError.outliers <= allowedOutliers;
+                    checked++;
+
+                    cout << (passed ? "ok   " : "FAIL ") << label << ": ";
+                    if (imageError.maxError == 0)
+                        cout << "identical";
+                    else
+                        cout << "PSNR " << imageError.psnr << " dB, max error " << imageError.maxError << ", "
+                             << imageError.outliers << " pixels over " << maxError;
+                    cout << endl;
+                    if (passed)
+                        continue;
+
+                    string base = string(DIFF_DIRECTORY) + "/" + name + "_" + traversal.name + "_" + kernel;
+                    writeImage(base + ".render.ppm", raytracer.frameBuffer);
+                    writeImage(base + ".diff.ppm", diff);
+                    cout << "     wrote " << base << ".render.ppm and " << base << ".diff.ppm" << endl;
+                    failures.push_back(label);
+                }
+            }
+        }
+    }
+
+    if (update)
+        return 0;
+    if (!failures.empty())
+    {
+        cout << endl << "FAILED: " << failures.size() << " of " << checked << " checks, images off their references (PSNR below "
+             << minPsnr << " dB, or more than " << allowedOutliers << " pixels off by over " << maxError
+             << ") or shadow rays off the closest hit:" << endl;
+        for (const string &failure : failures)
+            cout << "  " << failure << endl;
+        return 1;
+    }
+    cout << endl << "All " << checked << " checks passed, the images match their references and the shadow rays the closest hit" << endl;
+    return 0;
+}
@@ -0,0 +1,106 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  University of Leeds
+//  COMP 5892M Advanced Rendering
+//  User Interface for Coursework
+//
+//  September, 2022
+//
+//  ------------------------
+//  AABB.h
+//  ------------------------
+//
+//  A minimal axis aligned bounding box, used by the acceleration structures.
+//
+///////////////////////////////////////////////////
+
+#ifndef AABB_H
+#define AABB_H
+
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include "Cartesian3.h"
+
+class AABB
+    { // AABB
+    public:
+    // the two corners of the box
+    Cartesian3 min, max;
+
+    // constructors - the default box is empty, so that growing it always works
+    inline AABB()
+        : min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()),
+          max(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max())
+    {}
+
+    inline AABB(const Cartesian3 &Min, const Cartesian3 &Max) : min(Min), max(Max)
+    {}
+
+    // grow the box to contain a point
+    inline void grow(const Cartesian3 &p)
+    {
+        min = Cartesian3(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+        max = Cartesian3(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+    }
+
+    // grow the box to contain another box
+    inline void grow(const AABB &other)
+    {
+        min = Cartesian3(std::min(min.x, other.min.x), std::min(min.y, other.min.y), std::min(min.z, other.min.z));
+        max = Cartesian3(std::max(max.x, other.max.x), std::max(max.y, other.max.y), std::max(max.z, other.max.z));
+    }
+
+    // grow the box by a small amount relative to its magnitude, so that a ray
+    // lying exactly in one of its faces is still found inside it
+    inline void pad()
+    {
+        float scale = std::max({std::fabs(min.x), std::fabs(min.y), std::fabs(min.z),
+                                std::fabs(max.x), std::fabs(max.y), std::fabs(max.z), 1.0f});
+        Cartesian3 p(scale * 1e-6f, scale * 1e-6f, scale * 1e-6f);
+        min = min - p;
+        max = max + p;
+    }
+
+    inline bool isEmpty() const
+    {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    inline Cartesian3 centroid() const
+    {
+        return (min + max) * 0.5f;
+    }
+
+    inline Cartesian3 extent() const
+    {
+        return max - min;
+    }
+
+    // half of the surface area, which is all the SAH needs
+    inline float halfArea() const
+    {
+        if (isEmpty())
+            return 0.0f;
+        Cartesian3 e = extent();
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+
+    // the axis along which the box is longest
+    inline int longestAxis() const
+    {
+        Cartesian3 e = extent();
+        if (e.x > e.y && e.x > e.z)
+            return 0;
+        return e.y > e.z ? 1 : 2;
+    }
+
+    }; // AABB
+
+// helper to index a Cartesian3 by axis
+inline float axisValue(const Cartesian3 &p, int axis)
+{
+    return axis == 0 ? p.x : (axis == 1 ? p.y : p.z);
+}
+
+#endif // AABB_H
@@ -0,0 +1,325 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  University of Leeds
+//  COMP 5892M Advanced Rendering
+//  User Interface for Coursework
+////////////////////////////////////////////////////////////////////////
+
+#include "BVH.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <omp.h>
+
+// leaves never grow past this, whatever the SAH says
+#define BVH_MAX_LEAF_SIZE 8
+// the traversal stack is fixed size, so the tree depth is capped below it
+#define BVH_MAX_DEPTH 60
+// relative costs of stepping through a node and of testing a primitive
+#define BVH_TRAVERSAL_COST 1.0f
+#define BVH_INTERSECTION_COST 1.0f
+// number of SAH buckets per axis
+#define BVH_BINS 16
+// subtrees smaller than this are built by the thread that split them off
+#define BVH_TASK_THRESHOLD 4096
+// nodes bigger than this are binned by several threads, in chunks of BVH_BINNING_CHUNK
+#define BVH_PARALLEL_BINNING_THRESHOLD 65536
+#define BVH_BINNING_CHUNK 16384
+
+namespace
+{
+    struct Bin{
+        AABB bounds;
+        AABB centroidBounds;
+        int count = 0;
+    };
+
+    // bins for the three axes of one node
+    struct BinSet{
+        Bin bins[3][BVH_BINS];
+
+        void merge(const BinSet &other)
+        {
+            for (int axis = 0; axis < 3; axis++)
+                for (int b = 0; b < BVH_BINS; b++)
+                {
+                    bins[axis][b].bounds.grow(other.bins[axis][b].bounds);
+                    bins[axis][b].centroidBounds.grow(other.bins[axis][b].centroidBounds);
+                    bins[axis][b].count += other.bins[axis][b].count;
+                }
+        }
+    };
+
+    inline int binIndex(const Cartesian3 &centroid, int axis, const AABB &centroidBounds, float scale)
+    {
+        int b = int((axisValue(centroid, axis) - axisValue(centroidBounds.min, axis)) * scale);
+        return std::clamp(b, 0, BVH_BINS - 1);
+    }
+}
+
+// everything the recursive build shares
+struct BVH::BuildState{
+    const std::vector<AABB> &primitiveBounds;
+    std::vector<Cartesian3> centroids;
+    std::atomic<int> nodesUsed;
+    int groupWidth;
+
+    BuildState(const std::vector<AABB> &bounds, int width) : primitiveBounds(bounds), centroids(bounds.size()), nodesUsed(1), groupWidth(width)
+    {}
+
+    // the SAH counts the groups of primitives a leaf will be tested in
+    inline float groups(int count) const {return float((count + groupWidth - 1) / groupWidth);}
+};
+
+void BVH::clear()
+{
+    std::vector<Node>().swap(nodes);
+    std::vector<int>().swap(primitiveIndices);
+}
+
+void BVH::build(const std::vector<AABB> &primitiveBounds, int groupWidth)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    clear();
+    buildTime = 0.0f;
+    if (primitiveBounds.empty())
+        return;
+
+    int n = int(primitiveBounds.size());
+    BuildState state(primitiveBounds, groupWidth);
+    primitiveIndices.resize(n);
+
+    AABB rootBounds;
+    AABB rootCentroidBounds;
+    #pragma omp parallel
+    {
+        AABB localBounds;
+        AABB localCentroidBounds;
+        #pragma omp for nowait
+        for (int i = 0; i < n; i++)
+        {
+            state.centroids[i] = primitiveBounds[i].centroid();
+            primitiveIndices[i] = i;
+            localBounds.grow(primitiveBounds[i]);
+            localCentroidBounds.grow(state.centroids[i]);
+        }
+        #pragma omp critical
+        {
+            rootBounds.grow(localBounds);
+            rootCentroidBounds.grow(localCentroidBounds);
+        }
+    }
+
+    // a binary tree with n leaves at most has 2n-1 nodes, so the threads can
+    // hand out node pairs from a counter instead of growing the vector
+    nodes.resize(2 * n - 1);
+    nodes[0].bounds = rootBounds;
+    nodes[0].leftFirst = 0;
+    nodes[0].count = n;
+
+    #pragma omp parallel
+    #pragma omp single
+    subdivide(&state, 0, 0, rootCentroidBounds);
+
+    nodes.resize(state.nodesUsed);
+    nodes.shrink_to_fit();
+
+    buildTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::vector<int> BVH::groupLeaves(int width)
+{
+    std::vector<int> grouped;
+    int groups = 0;
+    for (Node &node : nodes)
+    {
+        if (!node.isLeaf())
+            continue;
+        int leafGroups = (node.count + width - 1) / width;
+        for (int i = 0; i < leafGroups * width; i++)
+            grouped.push_back(i < node.count ? primitiveIndices[node.leftFirst + i] : -1);
+        node.leftFirst = groups;
+        node.count = leafGroups;
+        groups += leafGroups;
+    }
+
+    primitiveIndices.resize(groups);
+    for (int i = 0; i < groups; i++)
+        primitiveIndices[i] = i;
+    return grouped;
+}
+
+// binned SAH: the centroids of the node are sorted into BVH_BINS buckets per
+// axis and only the bucket boundaries are evaluated as split positions
+void BVH::subdivide(BuildState *state, int nodeIndex, int depth, AABB centroidBounds)
+{
+    Node &node = nodes[nodeIndex];
+    int first = node.leftFirst;
+    int count = node.count;
+
+    // only the stored box is padded, the SAH works on the exact bounds
+    AABB exactBounds = node.bounds;
+    node.bounds.pad();
+
+    if (count <= 1 || depth >= BVH_MAX_DEPTH)
+        return;
+
+    float scale[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float extent = axisValue(centroidBounds.extent(), axis);
+        scale[axis] = extent > 0.0f ? float(BVH_BINS) / extent : 0.0f;
+    }
+
+    BinSet binSet;
+    auto binRange = [&](BinSet &target, int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            int primitive = primitiveIndices[i];
+            const Cartesian3 &c = state->centroids[primitive];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                Bin &bin = target.bins[axis][binIndex(c, axis, centroidBounds, scale[axis])];
+                bin.bounds.grow(state->primitiveBounds[primitive]);
+                bin.centroidBounds.grow(c);
+                bin.count++;
+            }
+        }
+    };
+
+    if (count > BVH_PARALLEL_BINNING_THRESHOLD)
+    {
+        int chunks = (count + BVH_BINNING_CHUNK - 1) / BVH_BINNING_CHUNK;
+        std::vector<BinSet> chunkBins(chunks);
+        #pragma omp taskloop shared(chunkBins, binRange)
+        for (int chunk = 0; chunk < chunks; chunk++)
+            binRange(chunkBins[chunk], first + chunk * BVH_BINNING_CHUNK, std::min(first + count, first + (chunk + 1) * BVH_BINNING_CHUNK));
+        for (int chunk = 0; chunk < chunks; chunk++)
+            binSet.merge(chunkBins[chunk]);
+    }
+    else
+    {
+        binRange(binSet, first, first + count);
+    }
+
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1;
+    int bestSplit = -1;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (scale[axis] == 0.0f)
+            continue;
+
+        const Bin *bins = binSet.bins[axis];
+        // sweep from the right to get the area and count of everything past each boundary
+        float rightArea[BVH_BINS];
+        int rightCount[BVH_BINS];
+        AABB right;
+        int rightSum = 0;
+        for (int b = BVH_BINS - 1; b > 0; b--)
+        {
+            right.grow(bins[b].bounds);
+            rightSum += bins[b].count;
+            rightArea[b] = right.halfArea();
+            rightCount[b] = rightSum;
+        }
+
+        AABB left;
+        int leftSum = 0;
+        for (int b = 1; b < BVH_BINS; b++)
+        {
+            left.grow(bins[b - 1].bounds);
+            leftSum += bins[b - 1].count;
+            if (leftSum == 0 || rightCount[b] == 0)
+                continue;
+            float cost = left.halfArea() * state->groups(leftSum) + rightArea[b] * state->groups(rightCount[b]);
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b;
+            }
+        }
+    }
+
+    int leftCount = 0;
+    AABB leftBounds, rightBounds, leftCentroids, rightCentroids;
+
+    if (bestAxis == -1)
+    {
+        // every centroid is in the same spot, so there is nothing to bin. Such
+        // a node is still split in half if it is too big to be a leaf
+        if (count <= BVH_MAX_LEAF_SIZE)
+            return;
+
+        leftCount = count / 2;
+        for (int i = first; i < first + count; i++)
+        {
+            int primitive = primitiveIndices[i];
+            AABB &bounds = i < first + leftCount ? leftBounds : rightBounds;
+            AABB &centroids = i < first + leftCount ? leftCentroids : rightCentroids;
+            bounds.grow(state->primitiveBounds[primitive]);
+            centroids.grow(state->centroids[primitive]);
+        }
+    }
+    else
+    {
+        float parentArea = exactBounds.halfArea();
+        // a flat node (e.g. a single axis aligned wall) has no area, all splits are equal then
+        if (parentArea > 0.0f)
+            bestCost = BVH_TRAVERSAL_COST + BVH_INTERSECTION_COST * bestCost / parentArea;
+        else
+            bestCost = BVH_TRAVERSAL_COST + BVH_INTERSECTION_COST * state->groups(count) * 0.5f;
+        float leafCost = BVH_INTERSECTION_COST * state->groups(count);
+
+        if (bestCost >= leafCost && count <= BVH_MAX_LEAF_SIZE)
+            return;
+
+        const Bin *bins = binSet.bins[bestAxis];
+        for (int b = 0; b < BVH_BINS; b++)
+        {
+            if (b < bestSplit)
+            {
+                leftBounds.grow(bins[b].bounds);
+                leftCentroids.grow(bins[b].centroidBounds);
+                leftCount += bins[b].count;
+            }
+            else
+            {
+                rightBounds.grow(bins[b].bounds);
+                rightCentroids.grow(bins[b].centroidBounds);
+            }
+        }
+
+        std::partition(primitiveIndices.begin() + first, primitiveIndices.begin() + first + count, [&](int primitive) {
+            return binIndex(state->centroids[primitive], bestAxis, centroidBounds, scale[bestAxis]) < bestSplit;
+        });
+    }
+
+    int leftIndex = state->nodesUsed.fetch_add(2);
+    Node &leftChild = nodes[leftIndex];
+    leftChild.bounds = leftBounds;
+    leftChild.leftFirst = first;
+    leftChild.count = leftCount;
+    Node &rightChild = nodes[leftIndex + 1];
+    rightChild.bounds = rightBounds;
+    rightChild.leftFirst = first + leftCount;
+    rightChild.count = count - leftCount;
+
+    node.leftFirst = leftIndex;
+    node.count = 0;
+
+    // big subtrees become tasks for the other threads, the right one stays on this thread
+    if (leftCount > BVH_TASK_THRESHOLD)
+    {
+        #pragma omp task
+        subdivide(state, leftIndex, depth + 1, leftCentroids);
+    }
+    else
+    {
+        subdivide(state, leftIndex, depth + 1, leftCentroids);
+    }
+    subdivide(state, leftIndex + 1, depth + 1, rightCentroids);
+}
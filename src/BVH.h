@@ -0,0 +1,182 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  University of Leeds
+//  COMP 5892M Advanced Rendering
+//  User Interface for Coursework
+//
+//  September, 2022
+//
+//  ------------------------
+//  BVH.h
+//  ------------------------
+//
+//  A binary bounding volume hierarchy built with the surface area heuristic.
+//  It only knows about primitive bounds, the caller intersects the primitives.
+//
+///////////////////////////////////////////////////
+
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include <limits>
+#include <cmath>
+#include "AABB.h"
+#include "Ray.h"
+
+class BVH
+{
+
+public:
+
+    struct Node{
+        AABB bounds;
+        // interior node: index of the left child, the right child is the next node
+        // leaf: index of the first entry in primitiveIndices
+        int leftFirst;
+        // number of primitives in a leaf, 0 for interior nodes
+        int count;
+
+        inline bool isLeaf() const {return count > 0;}
+    };
+
+    std::vector<Node> nodes;
+    // primitive ids in leaf order
+    std::vector<int> primitiveIndices;
+    // wall clock seconds spent in the last build
+    float buildTime = 0.0f;
+
+    // binned SAH build, parallelised with OpenMP tasks. groupWidth primitives
+    // are tested for the cost of one, for leaves that will be grouped later
+    void build(const std::vector<AABB> &primitiveBounds, int groupWidth = 1);
+    void clear();
+    inline bool isBuilt() const {return !nodes.empty();}
+
+    // splits the primitives of every leaf into groups of up to width, and
+    // returns their ids group by group, with -1 filling up the last group of
+    // each leaf. From then on the leaves count in groups and traverse hands
+    // out group indices instead of primitive ids
+    std::vector<int> groupLeaves(int width);
+
+    // closest hit traversal over [r.tMin, tMax], near child first. intersectPrimitive(id) is
+    // called for every candidate and is expected to shrink tMax on a hit,
+    // which culls every node that starts behind it. It returns true to end
+    // the traversal there, which is all an occlusion query needs.
+    // Returns the number of nodes visited, inner nodes and leaves
+    template <typename PrimitiveFunction>
+    int traverse(const Ray &r, float &tMax, PrimitiveFunction intersectPrimitive) const;
+
+    // ray-box slab test against [tMin, tMax], returns the entry distance or max float on a miss
+    static inline float intersectBox(const AABB &box, const Cartesian3 &origin, const Cartesian3 &invDir, float tMin, float tMax);
+
+    // rays that graze an edge of a flat box must not slip through rounding, so
+    // box distances are compared with a little slack (see PBRT, robust ray-bounds intersection)
+    static constexpr float boxTolerance = 1.0f + 4.0f * std::numeric_limits<float>::epsilon();
+
+    // 1/direction, with zero components replaced so -ffast-math never sees an infinity
+    static inline Cartesian3 inverseDirection(const Cartesian3 &direction);
+
+private:
+    struct BuildState;
+    void subdivide(BuildState *state, int nodeIndex, int depth, AABB centroidBounds);
+
+};
+
+inline Cartesian3 BVH::inverseDirection(const Cartesian3 &direction)
+{
+    float const tiny = 1e-20f;
+    return Cartesian3(
+        1.0f / (std::fabs(direction.x) > tiny ? direction.x : std::copysign(tiny, direction.x)),
+        1.0f / (std::fabs(direction.y) > tiny ? direction.y : std::copysign(tiny, direction.y)),
+        1.0f / (std::fabs(direction.z) > tiny ? direction.z : std::copysign(tiny, direction.z)));
+}
+
+inline float BVH::intersectBox(const AABB &box, const Cartesian3 &origin, const Cartesian3 &invDir, float tMin, float tMax)
+{
+    float tx1 = (box.min.x - origin.x) * invDir.x;
+    float tx2 = (box.max.x - origin.x) * invDir.x;
+    float tmin = std::min(tx1, tx2);
+    float tmax = std::max(tx1, tx2);
+
+    float ty1 = (box.min.y - origin.y) * invDir.y;
+    float ty2 = (box.max.y - origin.y) * invDir.y;
+    tmin = std::max(tmin, std::min(ty1, ty2));
+    tmax = std::min(tmax, std::max(ty1, ty2));
+
+    float tz1 = (box.min.z - origin.z) * invDir.z;
+    float tz2 = (box.max.z - origin.z) * invDir.z;
+    tmin = std::max(tmin, std::min(tz1, tz2));
+    tmax = std::min(tmax, std::max(tz1, tz2));
+
+    tmax *= boxTolerance;
+    tmin = std::max(tmin, tMin);
+    if (tmax >= tmin && tmin <= tMax * boxTolerance)
+        return tmin;
+    return std::numeric_limits<float>::max();
+}
+
+template <typename PrimitiveFunction>
+int BVH::traverse(const Ray &r, float &tMax, PrimitiveFunction intersectPrimitive) const
+{
+    if (nodes.empty())
+        return 0;
+
+    Cartesian3 invDir = inverseDirection(r.direction);
+
+    // the builder caps the depth, so a fixed stack is enough
+    struct StackEntry{
+        int node;
+        float t;
+    };
+    StackEntry stack[64];
+    int stackSize = 0;
+
+    float rootT = intersectBox(nodes[0].bounds, r.origin, invDir, r.tMin, tMax);
+    if (rootT == std::numeric_limits<float>::max())
+        return 0;
+    stack[stackSize++] = {0, rootT};
+    int visited = 0;
+
+    while (stackSize > 0)
+    {
+        StackEntry entry = stack[--stackSize];
+        // something closer may have been found since this node was pushed
+        if (entry.t > tMax * boxTolerance)
+            continue;
+
+        const Node *node = &nodes[entry.node];
+        while (!node->isLeaf())
+        {
+            visited++;
+            int nearIndex = node->leftFirst;
+            int farIndex = node->leftFirst + 1;
+            float tNear = intersectBox(nodes[nearIndex].bounds, r.origin, invDir, r.tMin, tMax);
+            float tFar = intersectBox(nodes[farIndex].bounds, r.origin, invDir, r.tMin, tMax);
+            if (tFar < tNear)
+            {
+                std::swap(nearIndex, farIndex);
+                std::swap(tNear, tFar);
+            }
+
+            if (tNear == std::numeric_limits<float>::max())
+            {
+                node = nullptr;
+                break;
+            }
+            if (tFar != std::numeric_limits<float>::max())
+                stack[stackSize++] = {farIndex, tFar};
+            node = &nodes[nearIndex];
+        }
+
+        if (node == nullptr)
+            continue;
+
+        visited++;
+        for (int i = node->leftFirst; i < node->leftFirst + node->count; i++)
+            if (intersectPrimitive(primitiveIndices[i]))
+                return visited;
+    }
+    return visited;
+}
+
+#endif // BVH_H
@@ -0,0 +1,94 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  University of Leeds
+//  COMP 5892M Advanced Rendering
+//  User Interface for Coursework
+////////////////////////////////////////////////////////////////////////
+
+#include "CompressedBVH.h"
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+    // the smallest and largest steps whose planes still contain [low, high]
+    void quantizeRange(float low, float high, float origin, float step, uint8_t &qLow, uint8_t &qHigh)
+    {
+        if (step <= 0.0f)
+        {
+            qLow = qHigh = 0;
+            return;
+        }
+        int lowStep = std::clamp(int(std::floor((low - origin) / step)), 0, 255);
+        int highStep = std::clamp(int(std::ceil((high - origin) / step)), 0, 255);
+        // the divisions round, so check against the planes the traversal will see
+        while (lowStep > 0 && origin + step * lowStep > low)
+            lowStep--;
+        while (highStep < 255 && origin + step * highStep < high)
+            highStep++;
+        qLow = uint8_t(lowStep);
+        qHigh = uint8_t(highStep);
+    }
+}
+
+void CompressedBVH::clear()
+{
+    decltype(nodes)().swap(nodes);
+    std::vector<int>().swap(primitiveIndices);
+}
+
+void CompressedBVH::build(const BVH &binary)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    clear();
+    buildTime = 0.0f;
+    if (!binary.isBuilt())
+        return;
+
+    primitiveIndices = binary.primitiveIndices;
+    rootBounds = binary.nodes[0].bounds;
+
+    // the binary tree keeps its root alone at 0 and the child pairs from 1 on.
+    // One empty node after the root moves every pair onto an even index
+    auto nodeIndex = [](int binaryNode) {return binaryNode == 0 ? 0 : binaryNode + 1;};
+    nodes.resize(binary.nodes.size() + 1);
+    std::memset(nodes.data(), 0, nodes.size() * sizeof(Node));
+
+    // top down, as every node is quantized within the box its parent decodes to
+    struct Pending{
+        int binaryNode;
+        AABB bounds;
+    };
+    std::vector<Pending> pending;
+    pending.push_back({0, rootBounds});
+    while (!pending.empty())
+    {
+        Pending current = pending.back();
+        pending.pop_back();
+        const BVH::Node &source = binary.nodes[current.binaryNode];
+        Node &node = nodes[nodeIndex(current.binaryNode)];
+
+        if (source.isLeaf())
+        {
+            node.leftFirst = -1 - source.leftFirst;
+            std::memcpy(node.quantized, &source.count, sizeof(source.count));
+            continue;
+        }
+
+        node.leftFirst = nodeIndex(source.leftFirst);
+        Cartesian3 step = quantizationStep(current.bounds);
+        for (int child = 0; child < 2; child++)
+        {
+            const AABB &exact = binary.nodes[source.leftFirst + child].bounds;
+            uint8_t *q = node.quantized + 6 * child;
+            quantizeRange(exact.min.x, exact.max.x, current.bounds.min.x, step.x, q[0], q[3]);
+            quantizeRange(exact.min.y, exact.max.y, current.bounds.min.y, step.y, q[1], q[4]);
+            quantizeRange(exact.min.z, exact.max.z, current.bounds.min.z, step.z, q[2], q[5]);
+            pending.push_back({source.leftFirst + child, childBounds(node, child, current.bounds)});
+        }
+    }
+
+    buildTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+}
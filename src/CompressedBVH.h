@@ -0,0 +1,177 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  University of Leeds
+//  COMP 5892M Advanced Rendering
+//  User Interface for Coursework
+//
+//  September, 2022
+//
+//  ------------------------
+//  CompressedBVH.h
+//  ------------------------
+//
+//  A binary BVH in 16 byte nodes, for scenes where the tree does not fit
+//  in the caches. Every node stores the boxes of its two children with
+//  8 bits per plane, relative to its own box, which the traversal carries
+//  down from the root.
+//
+///////////////////////////////////////////////////
+
+#ifndef COMPRESSED_BVH_H
+#define COMPRESSED_BVH_H
+
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <new>
+#include "BVH.h"
+
+// hands out memory on a cache line boundary, so that the layout of the
+// nodes within the lines is fixed
+template <typename T>
+struct CacheLineAllocator{
+    using value_type = T;
+    static constexpr std::size_t alignment = 64;
+
+    CacheLineAllocator() = default;
+    template <typename U>
+    CacheLineAllocator(const CacheLineAllocator<U> &) {}
+
+    T *allocate(std::size_t n) {return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(alignment)));}
+    void deallocate(T *p, std::size_t) {::operator delete(p, std::align_val_t(alignment));}
+
+    template <typename U>
+    bool operator==(const CacheLineAllocator<U> &) const {return true;}
+};
+
+class CompressedBVH
+{
+
+public:
+
+    struct alignas(16) Node{
+        // min x, y, z then max x, y, z of the left child, then of the right
+        // child, as steps of 1/255 of this node's box. A leaf keeps its
+        // primitive count in the first four bytes instead
+        uint8_t quantized[12];
+        // interior node: index of the left child, the right child is the next node
+        // leaf: -1 - the index of the first entry in primitiveIndices
+        int32_t leftFirst;
+
+        inline bool isLeaf() const {return leftFirst < 0;}
+        inline int first() const {return -1 - leftFirst;}
+        inline int count() const {int c; std::memcpy(&c, quantized, sizeof(c)); return c;}
+    };
+
+    // the child pairs start on even indices of a cache line aligned array,
+    // so the 32 bytes of a pair never straddle a cache line
+    std::vector<Node, CacheLineAllocator<Node>> nodes;
+    std::vector<int> primitiveIndices;
+    // the root box is the only one kept in full
+    AABB rootBounds;
+    // wall clock seconds spent compressing the binary tree
+    float buildTime = 0.0f;
+
+    // quantizes a built binary tree, keeping its leaves
+    void build(const BVH &binary);
+    void clear();
+    inline bool isBuilt() const {return !nodes.empty();}
+
+    // same contract as BVH::traverse
+    template <typename PrimitiveFunction>
+    int traverse(const Ray &r, float &tMax, PrimitiveFunction intersectPrimitive) const;
+
+    // the box of one child, from the box of its parent
+    static inline AABB childBounds(const Node &node, int child, const AABB &parentBounds);
+    // the size of one quantization step. It is rounded up a little, so that
+    // a child at the top of the range is never cut short by rounding
+    static inline Cartesian3 quantizationStep(const AABB &parentBounds);
+
+};
+
+inline Cartesian3 CompressedBVH::quantizationStep(const AABB &parentBounds)
+{
+    return parentBounds.extent() * ((1.0f + 1e-6f) / 255.0f);
+}
+
+inline AABB CompressedBVH::childBounds(const Node &node, int child, const AABB &parentBounds)
+{
+    const uint8_t *q = node.quantized + 6 * child;
+    Cartesian3 step = quantizationStep(parentBounds);
+    return AABB(Cartesian3(parentBounds.min.x + step.x * q[0], parentBounds.min.y + step.y * q[1], parentBounds.min.z + step.z * q[2]),
+                Cartesian3(parentBounds.min.x + step.x * q[3], parentBounds.min.y + step.y * q[4], parentBounds.min.z + step.z * q[5]));
+}
+
+template <typename PrimitiveFunction>
+int CompressedBVH::traverse(const Ray &r, float &tMax, PrimitiveFunction intersectPrimitive) const
+{
+    if (nodes.empty())
+        return 0;
+
+    Cartesian3 invDir = BVH::inverseDirection(r.direction);
+
+    // the box of a node is only known from its parent, so it goes on the stack with it
+    struct StackEntry{
+        int node;
+        float t;
+        AABB bounds;
+    };
+    StackEntry stack[64];
+    int stackSize = 0;
+
+    float rootT = BVH::intersectBox(rootBounds, r.origin, invDir, r.tMin, tMax);
+    if (rootT == std::numeric_limits<float>::max())
+        return 0;
+    stack[stackSize++] = {0, rootT, rootBounds};
+    int visited = 0;
+
+    while (stackSize > 0)
+    {
+        StackEntry entry = stack[--stackSize];
+        // something closer may have been found since this node was pushed
+        if (entry.t > tMax * BVH::boxTolerance)
+            continue;
+
+        const Node *node = &nodes[entry.node];
+        AABB bounds = entry.bounds;
+        while (!node->isLeaf())
+        {
+            visited++;
+            int nearIndex = node->leftFirst;
+            int farIndex = node->leftFirst + 1;
+            AABB nearBounds = childBounds(*node, 0, bounds);
+            AABB farBounds = childBounds(*node, 1, bounds);
+            float tNear = BVH::intersectBox(nearBounds, r.origin, invDir, r.tMin, tMax);
+            float tFar = BVH::intersectBox(farBounds, r.origin, invDir, r.tMin, tMax);
+            if (tFar < tNear)
+            {
+                std::swap(nearIndex, farIndex);
+                std::swap(nearBounds, farBounds);
+                std::swap(tNear, tFar);
+            }
+
+            if (tNear == std::numeric_limits<float>::max())
+            {
+                node = nullptr;
+                break;
+            }
+            if (tFar != std::numeric_limits<float>::max())
+                stack[stackSize++] = {farIndex, tFar, farBounds};
+            node = &nodes[nearIndex];
+            bounds = nearBounds;
+        }
+
+        if (node == nullptr)
+            continue;
+
+        visited++;
+        for (int i = node->first(); i < node->first() + node->count(); i++)
+            if (intersectPrimitive(primitiveIndices[i]))
+                return visited;
+    }
+    return visited;
+}
+
+#endif // COMPRESSED_BVH_H
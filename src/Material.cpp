@@ -7,6 +7,8 @@
 
 #include "Material.h"
 #include <string>
+#include <math.h>
+#include <algorithm>
 Material::Material(Cartesian3 ambient,Cartesian3 diffuse,Cartesian3 specular,Cartesian3 emissive,float shininess,std::istream &textureStream)
 {
     this->ambient = ambient;
@@ -157,3 +159,55 @@ bool Material::isLight(){
     std::size_t found = name.find("light");
     return found !=std::string::npos;
 }
+
+// position and (unit) normal are those of the shaded point, in the same space as the light and eye
+Homogeneous4 Material::phongShading(Homogeneous4 lightPos, Homogeneous4 lightColor, Cartesian3 position, Cartesian3 normal, Cartesian3 eye) const
+{
+     
+    Homogeneous4 color;
+
+    Cartesian3 l = (lightPos.Point() - position).unit();
+    Cartesian3 LIGHT_COLOR = lightColor.Vector();
+
+    // ambient
+    Cartesian3 ambient = Cartesian3(this->ambient.x * LIGHT_COLOR.x , this->ambient.y * LIGHT_COLOR.y, this->ambient.z * LIGHT_COLOR.z);
+
+    // diffuse
+    float cosTheta = std::clamp(normal.dot(l), 0.0f, 1.0f);
+    Cartesian3 diffuse = (this->diffuse);
+    diffuse = Cartesian3(diffuse.x * LIGHT_COLOR.x , diffuse.y * LIGHT_COLOR.y , diffuse.z * LIGHT_COLOR.z);
+    diffuse = diffuse * cosTheta;
+
+    // specular
+    Cartesian3 e = (eye - position).unit();
+    Cartesian3 B = (l + e).unit();
+    float cosB = std::clamp(normal.dot(B), 0.0f, 1.0f);
+
+    cosB = std::clamp(pow(cosB, shininess), 0.0f, 1.0f);
+
+    cosB = cosB * cosTheta * (shininess + 2) / (2*M_PI);
+
+    Cartesian3 specular = (this->specular);
+    specular = Cartesian3(specular.x * LIGHT_COLOR.x , specular.y * LIGHT_COLOR.y , specular.z * LIGHT_COLOR.z);
+    specular = specular * cosB;
+
+    color = diffuse + specular + ambient;
+
+    return color;
+
+}
+
+
+Homogeneous4 Material::shadowShading(Homogeneous4 lightColor) const
+{
+    Homogeneous4 color;
+
+    Cartesian3 LIGHT_COLOR = lightColor.Vector();
+
+    // ambient
+    Cartesian3 ambient = Cartesian3(this->ambient.x * LIGHT_COLOR.x , this->ambient.y * LIGHT_COLOR.y, this->ambient.z * LIGHT_COLOR.z);
+
+    color = ambient;
+
+    return color;
+}
@@ -18,6 +18,7 @@
 #define MATERIAL_H
 
 #include "Cartesian3.h"
+#include "Homogeneous4.h"
 #include "RGBAImage.h"
 #include <iostream>
 #include <fstream>
@@ -41,6 +42,10 @@ public:
     float transparency;
     RGBAImage *texture;
     bool isLight();
+    // Blinn-Phong for one light. position and (unit) normal are those of the shaded point
+    Homogeneous4 phongShading(Homogeneous4 lightPos, Homogeneous4 lightColor, Cartesian3 position, Cartesian3 normal, Cartesian3 eye) const;
+    // only the ambient term, for a point the light cannot see
+    Homogeneous4 shadowShading(Homogeneous4 lightColor) const;
     Material();
     Material(Cartesian3 ambient,Cartesian3 diffuse,Cartesian3 specular,Cartesian3 emissive,float shininess,std::istream &textureStream);
     Material(Cartesian3 ambient,Cartesian3 diffuse,Cartesian3 specular,Cartesian3 emissive,float shininess); //no texture in constructor;
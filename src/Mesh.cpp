@@ -0,0 +1,282 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  University of Leeds
+//  COMP 5892M Advanced Rendering
+//  User Interface for Coursework
+////////////////////////////////////////////////////////////////////////
+
+#include "Mesh.h"
+#include "RenderParameters.h"
+#include <algorithm>
+#include <bit>
+#include <unordered_map>
+
+namespace
+{
+    // one corner of an obj face: the position, normal and uv it indexes.
+    // Compared exactly, so no two corners ever share a vertex by accident
+    struct Corner{
+        unsigned int v, n, t;
+
+        bool operator==(const Corner &other) const
+        {
+            return v == other.v && n == other.n && t == other.t;
+        }
+    };
+
+    struct CornerHash{
+        size_t operator()(const Corner &c) const
+        {
+            uint64_t h = uint64_t(c.v) * 0x9E3779B97F4A7C15ull;
+            h ^= uint64_t(c.n) * 0xC2B2AE3D27D4EB4Full + (h >> 29);
+            h ^= uint64_t(c.t) * 0x165667B19E3779F9ull + (h >> 32);
+            return size_t(h);
+        }
+    };
+}
+
+void Mesh::clear()
+{
+    positions.clear();
+    normals.clear();
+    uvs.clear();
+    indices.clear();
+    material = nullptr;
+    packets.clear();
+    laneMasks.clear();
+    shadowMasks.clear();
+    firstID = 0;
+    bvh.clear();
+    wideBvh.clear();
+    compressedBvh.clear();
+    bounds = AABB();
+}
+
+void Mesh::addModel(const ThreeDModel &obj, Material *defaultMaterial, int &triID)
+{
+    if (indices.empty())
+        firstID = triID;
+    if(obj.material== nullptr){
+        material = defaultMaterial;
+    }else{
+        material = obj.material;
+    }
+
+    // the obj indexes positions, normals and uvs separately, a vertex here is
+    // one combination of the three. Each combination is only added once.
+    // Every object of a file shares the file's pools, so size for the corners
+    // of this object's triangles, not for every vertex in the file
+    size_t corners = std::min(obj.vertices.size(), 3 * obj.triangleCount());
+    std::unordered_map<Corner, unsigned int, CornerHash> vertexIndex;
+    vertexIndex.reserve(corners);
+    positions.reserve(positions.size() + corners);
+    normals.reserve(normals.size() + corners);
+    uvs.reserve(uvs.size() + corners);
+    indices.reserve(indices.size() + 3 * obj.triangleCount());
+    auto addVertex = [&](unsigned int v, unsigned int n, unsigned int t)
+    {
+        Corner key{v, n, t};
+        auto found = vertexIndex.find(key);
+        if (found != vertexIndex.end())
+            return found->second;
+
+        unsigned int index = (unsigned int)positions.size();
+        positions.push_back(obj.vertices[v]);
+        normals.push_back(obj.normals[n]);
+        const Cartesian3 &tex = obj.textureCoords[t];
+        uvs.push_back(Cartesian3(tex.x, tex.y, 0.0f));
+        vertexIndex.emplace(key, index);
+        return index;
+    };
+
+    // loop through the faces: note that they may not be triangles, which complicates life
+    for (unsigned int face = 0; face < obj.faceVertices.size(); face++)
+    { // per face
+        // on each face, treat it as a triangle fan starting with the first vertex on the face
+        for (unsigned int triangle = 0; triangle < obj.faceVertices[face].size() - 2; triangle++)
+        { // per triangle
+            // now do a loop over three vertices
+            for (unsigned int vertex = 0; vertex < 3; vertex++)
+            { // per vertex
+                // we always use the face's vertex 0
+                unsigned int faceVertex = 0;
+                // so if it isn't 0, we want to add the triangle base ID
+                if (vertex != 0)
+                    faceVertex = triangle + vertex;
+
+                //this is our vertex before any transformations. (object space)
+                indices.push_back(addVertex(obj.faceVertices[face][faceVertex], obj.faceNormals[face][faceVertex], obj.faceTexCoords[face][faceVertex]));
+            } // per vertex
+            triID++;
+        } // per triangle
+    } // per face
+}
+
+Triangle Mesh::triangle(int i) const
+{
+    Triangle t;
+    for (int vertex = 0; vertex < 3; vertex++)
+    {
+        unsigned int index = indices[3 * i + vertex];
+        const Cartesian3 &v = positions[index];
+        const Cartesian3 &n = normals[index];
+        t.verts[vertex] = Homogeneous4(v.x, v.y, v.z);
+        t.normals[vertex] = Homogeneous4(n.x, n.y, n.z, 0.0f);
+        t.uvs[vertex] = uvs[index];
+    }
+    t.validate(firstID + i);
+    t.shared_material = material;
+    return t;
+}
+
+void Mesh::build(bool useBVH, int layout)
+{
+    std::vector<AABB> triangleBounds(triangleCount());
+    #pragma omp parallel for
+    for (int i = 0; i < triangleCount(); i++)
+    {
+        for (int vertex = 0; vertex < 3; vertex++)
+            triangleBounds[i].grow(position(i, vertex));
+    }
+
+    bounds = AABB();
+    for (const AABB &b : triangleBounds)
+        bounds.grow(b);
+
+    //with the BVH disabled closestHit falls back to testing every triangle
+    std::vector<int> grouped;
+    if (useBVH)
+    {
+        bvh.build(triangleBounds, TrianglePacket::width);
+        grouped = bvh.groupLeaves(TrianglePacket::width);
+    }
+    else
+    {
+        bvh.clear();
+        grouped.resize(triangleCount());
+        for (int i = 0; i < triangleCount(); i++)
+            grouped[i] = i;
+        grouped.resize((grouped.size() + TrianglePacket::width - 1) / TrianglePacket::width * TrianglePacket::width, -1);
+    }
+
+    packets.assign(grouped.size() / TrianglePacket::width, TrianglePacket());
+    // lights do not cast shadows
+    uint8_t castsShadow = material != nullptr && !material->isLight() ? 0xff : 0;
+    laneMasks.assign(packets.size(), 0);
+    shadowMasks.assign(packets.size(), 0);
+    #pragma omp parallel for
+    for (int p = 0; p < int(packets.size()); p++)
+        for (int lane = 0; lane < TrianglePacket::width; lane++)
+        {
+            int i = grouped[p * TrianglePacket::width + lane];
+            if (i < 0)
+                continue;
+            packets[p].set(lane, position(i, 0), position(i, 1), position(i, 2), i);
+            laneMasks[p] |= uint8_t(1 << lane);
+            shadowMasks[p] |= uint8_t(1 << lane) & castsShadow;
+        }
+
+    wideBvh.clear();
+    compressedBvh.clear();
+    if (useBVH && layout == BVH_LAYOUT_WIDE)
+        wideBvh.build(bvh);
+    if (useBVH && layout == BVH_LAYOUT_COMPRESSED)
+        compressedBvh.build(bvh);
+    if (useBVH && layout != BVH_LAYOUT_BINARY)
+        bvh.clear();
+}
+
+bool Mesh::closestHit(const Ray &r, float &tMax, int &hitID, int &hitIndex, Cartesian3 &hitBarycentrics, RenderStats *stats)
+{
+    bool found = false;
+    ShearedRay sheared(r);
+    int tested = 0, visited = 0;
+    auto intersectPacket = [&](int p)
+    {
+        tested += std::popcount(unsigned(laneMasks[p]));
+        const TrianglePacket &packet = packets[p];
+        float t[TrianglePacket::width], u[TrianglePacket::width], v[TrianglePacket::width], w[TrianglePacket::width];
+        for (int mask = packet.intersect(sheared, tMax, t, u, v, w); mask != 0; mask &= mask - 1)
+        {
+            int lane = std::countr_zero(unsigned(mask));
+            int i = packet.index[lane];
+            // ties go to the lowest id, so we pick the same triangle as the linear scan
+            if (t[lane] < tMax || (t[lane] == tMax && firstID + i < hitID))
+            {
+                tMax = t[lane];
+                hitID = firstID + i;
+                hitIndex = i;
+                hitBarycentrics = Cartesian3(u[lane], v[lane], w[lane]);
+                found = true;
+            }
+        }
+        return false;
+    };
+
+    if (wideBvh.isBuilt())
+    {
+        visited = wideBvh.traverse(r, tMax, intersectPacket);
+    }
+    else if (compressedBvh.isBuilt())
+    {
+        visited = compressedBvh.traverse(r, tMax, intersectPacket);
+    }
+    else if (bvh.isBuilt())
+    {
+        visited = bvh.traverse(r, tMax, intersectPacket);
+    }
+    else
+    {
+        // interate the list of triangles in the mesh
+        for (int p = 0; p < int(packets.size()); p++)
+            intersectPacket(p);
+    }
+    if (stats)
+    {
+        stats->nodesVisited += visited;
+        stats->triangleTests += tested;
+    }
+    return found;
+}
+
+bool Mesh::occluded(const Ray &r, RenderStats *stats)
+{
+    bool found = false;
+    float tMax = r.tMax;
+    ShearedRay sheared(r);
+    int tested = 0, visited = 0;
+    auto intersectPacket = [&](int p)
+    {
+        if (shadowMasks[p] == 0)
+            return false;
+        tested += std::popcount(unsigned(laneMasks[p]));
+        const TrianglePacket &packet = packets[p];
+        float t[TrianglePacket::width], u[TrianglePacket::width], v[TrianglePacket::width], w[TrianglePacket::width];
+        found = (packet.intersect(sheared, tMax, t, u, v, w) & shadowMasks[p]) != 0;
+        return found;
+    };
+
+    if (wideBvh.isBuilt())
+    {
+        visited = wideBvh.traverse(r, tMax, intersectPacket);
+    }
+    else if (compressedBvh.isBuilt())
+    {
+        visited = compressedBvh.traverse(r, tMax, intersectPacket);
+    }
+    else if (bvh.isBuilt())
+    {
+        visited = bvh.traverse(r, tMax, intersectPacket);
+    }
+    else
+    {
+        for (int p = 0; p < int(packets.size()) && !found; p++)
+            intersectPacket(p);
+    }
+    if (stats)
+    {
+        stats->nodesVisited += visited;
+        stats->triangleTests += tested;
+    }
+    return found;
+}
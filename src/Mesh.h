@@ -0,0 +1,90 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  University of Leeds
+//  COMP 5892M Advanced Rendering
+//  User Interface for Coursework
+//
+//  September, 2022
+//
+//  ------------------------
+//  Mesh.h
+//  ------------------------
+//
+//  The triangles of one object in its own space, with the bottom level
+//  acceleration structure over them. Scene places meshes through instances.
+//  The triangles are indexed: corners that the obj shares are stored once.
+//
+///////////////////////////////////////////////////
+
+#ifndef MESH_H
+#define MESH_H
+
+#include <vector>
+#include <cstdint>
+#include "ThreeDModel.h"
+#include "Triangle.h"
+#include "TrianglePacket.h"
+#include "BVH.h"
+#include "WideBVH.h"
+#include "CompressedBVH.h"
+#include "AABB.h"
+#include "RenderStats.h"
+
+class Mesh
+{
+
+public:
+    // one entry per distinct position, normal and uv combination of the obj.
+    // Everything here is only read for the hit a query returns, the queries
+    // themselves run on packets, their masks and firstID
+    std::vector<Cartesian3> positions;
+    std::vector<Cartesian3> normals;
+    std::vector<Cartesian3> uvs;
+    // three vertices per triangle
+    std::vector<unsigned int> indices;
+    // every triangle of an object has the same material
+    Material *material = nullptr;
+    // the positions of the triangles in groups of eight, made by build. The
+    // leaves of the BVH refer to these, in the linear scan they are in order
+    std::vector<TrianglePacket> packets;
+    // per packet, the lanes holding a triangle, and those holding one that casts shadows
+    std::vector<uint8_t> laneMasks;
+    std::vector<uint8_t> shadowMasks;
+    // triangle_id of the first triangle, the ids of a mesh follow one another
+    int firstID = 0;
+    // only one of these is kept, depending on the layout. The other
+    // two layouts are made from the binary tree, which is then dropped
+    BVH bvh;
+    WideBVH wideBvh;
+    CompressedBVH compressedBvh;
+    // bounds of all the triangles, in mesh space
+    AABB bounds;
+
+    // fans the faces of obj into triangles, without any transformation.
+    // triangles are numbered from triID on, which is advanced past them
+    void addModel(const ThreeDModel &obj, Material *defaultMaterial, int &triID);
+    void clear();
+
+    inline int triangleCount() const {return int(indices.size() / 3);}
+    inline const Cartesian3 &position(int triangle, int corner) const {return positions[indices[3 * triangle + corner]];}
+    inline const Cartesian3 &normal(int triangle, int corner) const {return normals[indices[3 * triangle + corner]];}
+    // one triangle with its own copy of everything, for code that still wants a Triangle
+    Triangle triangle(int i) const;
+
+    // computes the bounds and, if asked for, the BVH in the given BVH_LAYOUT_*
+    void build(bool useBVH, int layout);
+
+    // closest hit against this mesh. If a triangle within the interval of the ray
+    // and no further than tMax is found, tMax, hitID (its triangle_id), hitIndex
+    // (its index in the mesh) and hitBarycentrics are updated and true is returned.
+    // Ties go to the lowest triangle_id, like the linear scan.
+    // The nodes visited and triangles tested are added to stats, if given
+    bool closestHit(const Ray &r, float &tMax, int &hitID, int &hitIndex, Cartesian3 &hitBarycentrics, RenderStats *stats = nullptr);
+
+    // whether any triangle that is not a light is hit within the interval
+    // of the ray. Stops at the first one found
+    bool occluded(const Ray &r, RenderStats *stats = nullptr);
+
+};
+
+#endif // MESH_H
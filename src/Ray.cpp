@@ -1,8 +1,10 @@
 #include "Ray.h"
 
-Ray::Ray(Cartesian3 og, Cartesian3 dir,Type rayType)
+Ray::Ray(Cartesian3 og, Cartesian3 dir,Type rayType, float minT, float maxT)
 {
     origin = og;
     direction = dir;
     ray_type = rayType;
+    tMin = minT;
+    tMax = maxT;
 }
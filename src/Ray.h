@@ -17,6 +17,7 @@
 #ifndef RAY_H
 #define RAY_H
 
+#include <limits>
 #include "Cartesian3.h"
 
 class Ray
@@ -25,10 +26,15 @@ class Ray
 
 public:
     enum Type{primary,secondary};
-    Ray(Cartesian3 og,Cartesian3 dir,Type rayType);
+    // an empty ray, to be assigned later
+    Ray() : ray_type(primary), tMin(0.0f), tMax(std::numeric_limits<float>::max()) {}
+    Ray(Cartesian3 og,Cartesian3 dir,Type rayType, float minT = 0.0f, float maxT = std::numeric_limits<float>::max());
     Cartesian3 origin;
     Cartesian3 direction;
     Type ray_type;
+    // only hits with tMin < t <= tMax count, in units of direction
+    float tMin;
+    float tMax;
 
 };
 
@@ -10,13 +10,26 @@
 #include <random>
 #include <omp.h>
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <utility>
 // include the header file
 #include "Raytracer.h"
+#include "TraceRecorder.h"
 
 #define N_THREADS 16
 #define N_LOOPS 600
 #define N_BOUNCES 10
 #define TERMINATION_FACTOR 0.35f
+// secondary rays start this far off the surface along the normal, so they do not hit it again
+#define SURFACE_EPSILON 0.001f
+// the pixel step of the first pass of a progressive frame. Every pass halves it
+#define PROGRESSIVE_FIRST_STEP 8
+static_assert(TILE_SIZE % PROGRESSIVE_FIRST_STEP == 0, "the blocks of a pass must not cross tiles");
+// the cost a pixel needs to come out red in the heatmap, nodes visited or triangles tested
+#define HEATMAP_MAX_NODES 1024
+#define HEATMAP_MAX_TESTS 4096
 
 Homogeneous4 const COLOR_black = Homogeneous4(0.0f, 0.0f, 0.0f, 1.0f);
 Homogeneous4 const COLOR_blue = Homogeneous4(0.0f, 0.0f, 1.0f, 1.0f);
@@ -33,12 +46,35 @@ Raytracer::Raytracer(std::vector<ThreeDModel> *newTexturedObject, RenderParamete
     std::srand(static_cast<unsigned int>(std::time(nullptr)));
     restartRaytrace = false;
     raytracingRunning = false;
+    frameNumber = 0;
+    busyWorkers = 0;
+    passWorkers = 0;
+    firstStep = 1;
+    passStep = 1;
+    shuttingDown = false;
+    frameKernel = nullptr;
+    lastRestartLatency = 0.0;
+
+    // as many render threads as OpenMP would use
+    int threads = std::max(1, omp_get_max_threads());
+    workerStats.resize(threads);
+    for (int i = 0; i < threads; i++)
+        workers.emplace_back(&Raytracer::RenderWorker, this, i);
 }
 
 Raytracer::~Raytracer()
 {
     // all of our pointers are to data owned by another class
-    // so we have no responsibility for destruction
+    // so we have no responsibility for destruction.
+    // The render threads are ours though
+    {
+        std::lock_guard<std::mutex> lock(frameLock);
+        shuttingDown = true;
+        restartRaytrace = true;
+    }
+    frameStarted.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
 }
 
 // called every time the widget is resized
@@ -52,13 +88,19 @@ void Raytracer::resize(int w, int h)
 
 void Raytracer::stopRaytracer()
 {
+    std::unique_lock<std::mutex> lock(frameLock);
+    if (busyWorkers == 0)
+        return;
+
+    // the workers look at restartRaytrace before every tile, and the last one
+    // to leave the frame wakes us up
+    TraceScope trace("stopRaytracer", "cancel");
+    TraceRecorder::instant("frame cancelled", "cancel");
+    auto start = std::chrono::steady_clock::now();
     restartRaytrace = true;
-    while (raytracingRunning)
-    {
-        std::chrono::milliseconds timespan(10);
-        std::this_thread::sleep_for(timespan);
-    }
+    frameFinished.wait(lock, [this] { return busyWorkers == 0; });
     restartRaytrace = false;
+    lastRestartLatency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 }
 
 inline float linear_from_srgb(std::uint8_t aValue) noexcept
@@ -78,36 +120,202 @@ inline std::uint8_t linear_to_srgb(float aValue) noexcept
     return std::uint8_t(255.f * (1.055f * std::pow(aValue, 1.f / 2.4f) - 0.055f) + 0.5f);
 }
 
-void Raytracer::RaytraceThread()
+// the work behind a pixel that the heatmap shows, read off a worker's counters
+static inline long heatmapCost(const RenderStats &stats, int mode)
+{
+    if (mode == HEATMAP_NODES)
+        return stats.nodesVisited;
+    if (mode == HEATMAP_TESTS)
+        return stats.triangleTests;
+    return 0;
+}
+
+// black through blue, cyan, green and yellow to red, on a log scale so that
+// both the cheap background and the worst spots show. The scale is fixed,
+// so two frames can be compared
+static RGBAValue heatmapColor(long cost, int mode)
+{
+    static const float ramp[6][3] = {{0, 0, 0}, {0, 0, 1}, {0, 1, 1}, {0, 1, 0}, {1, 1, 0}, {1, 0, 0}};
+    float top = mode == HEATMAP_NODES ? HEATMAP_MAX_NODES : HEATMAP_MAX_TESTS;
+    float v = std::clamp(std::log1p(float(cost)) / std::log1p(top), 0.0f, 1.0f) * 5.0f;
+    int stop = std::min(int(v), 4);
+    float f = v - float(stop);
+    float rgb[3];
+    for (int c = 0; c < 3; c++)
+        rgb[c] = ramp[stop][c] + (ramp[stop + 1][c] - ramp[stop][c]) * f;
+    return RGBAValue((unsigned char)(rgb[0] * 255.0f + 0.5f), (unsigned char)(rgb[1] * 255.0f + 0.5f), (unsigned char)(rgb[2] * 255.0f + 0.5f), (unsigned char)255);
+}
+
+template <int features>
+inline bool Raytracer::shades(int feature) const
 {
-    for (int j = 0; j < frameBuffer.height; j++)
+    if constexpr (features == SHADE_GENERIC)
+        return (renderParameters->shadingFeatures() & feature) != 0;
+    else
+        return (features & feature) != 0;
+}
+
+void Raytracer::RenderWorker(int worker)
+{
+    TraceRecorder::nameThread("render worker " + std::to_string(worker));
+    unsigned long renderedFrame = 0;
+    while (true)
     {
-        #pragma omp parallel for schedule(dynamic)
-        for (int i = 0; i < frameBuffer.width; i++)
+        TileKernel kernel;
+        int step;
         {
+            std::unique_lock<std::mutex> lock(frameLock);
+            frameStarted.wait(lock, [&] { return shuttingDown || frameNumber != renderedFrame; });
+            if (shuttingDown)
+                return;
+            renderedFrame = frameNumber;
+            kernel = frameKernel;
+            step = firstStep;
+        }
+
+        // pass by pass, our own tiles first, then the others'. A restart
+        // empties the passes left, but they are still gone through together
+        while (true)
+        {
+            TileScheduler::Tile tile;
+            while (!restartRaytrace && tileScheduler.next(worker, tile))
+            {
+                TraceScope trace("tile", "render");
+                trace.arg("x", tile.x0);
+                trace.arg("y", tile.y0);
+                trace.arg("step", step);
+                (this->*kernel)(tile, step, step != firstStep, workerStats[worker].stats);
+            }
+            if (step == 1)
+                break;
+            // the time spent here is the time this worker had nothing to do
+            TraceScope trace("pass barrier", "render");
+            trace.arg("step", step);
+            step = finishPass(step);
+        }
+
+        std::lock_guard<std::mutex> lock(frameLock);
+        if (--busyWorkers == 0)
+        {
+            // a cancelled frame only counts what it got through
+            if (renderParameters->statsEnabled && !restartRaytrace)
+            {
+                RenderStats total;
+                for (const WorkerStats &w : workerStats)
+                    total += w.stats;
+                total.print(std::cout);
+                std::cout << "Last restart " << lastRestartLatency << " ms" << std::endl;
+                std::cout << "====================================" << std::endl;
+            }
+            raytracingRunning = false;
+            frameFinished.notify_all();
+        }
+    }
+}
+
+RenderStats Raytracer::frameStats()
+{
+    // the workers only write their own, and are done with them once they leave the frame
+    std::lock_guard<std::mutex> lock(frameLock);
+    RenderStats total;
+    for (const WorkerStats &w : workerStats)
+        total += w.stats;
+    return total;
+}
+
+std::vector<RenderStats> Raytracer::threadStats()
+{
+    std::lock_guard<std::mutex> lock(frameLock);
+    std::vector<RenderStats> threads;
+    for (const WorkerStats &w : workerStats)
+        threads.push_back(w.stats);
+    return threads;
+}
+
+void Raytracer::startFrame()
+{
+    // the flags are looked at once per frame, the kernel for them has the rest compiled in
+    int features = renderParameters->specializedShading ? renderParameters->shadingFeatures() : SHADE_GENERIC;
+
+    {
+        std::lock_guard<std::mutex> lock(frameLock);
+        frameKernel = tileKernel(features);
+        tileScheduler.reset(frameBuffer.width, frameBuffer.height, int(workers.size()));
+        busyWorkers = int(workers.size());
+        passWorkers = int(workers.size());
+        for (WorkerStats &w : workerStats)
+            w.stats = RenderStats();
+        firstStep = renderParameters->progressiveRendering ? PROGRESSIVE_FIRST_STEP : 1;
+        passStep = firstStep;
+        // running before any worker can see the frame, so it cannot be over before it started
+        raytracingRunning = true;
+        frameNumber++;
+    }
+    frameStarted.notify_all();
+}
+
+int Raytracer::finishPass(int step)
+{
+    std::unique_lock<std::mutex> lock(frameLock);
+    if (--passWorkers == 0)
+    {
+        // the last one out sets up the next pass. The blocks of a pass only ever
+        // cover pixels of the same tile, but a pass must not start on a tile the
+        // pass before is still filling in
+        passWorkers = int(workers.size());
+        passStep = step / 2;
+        tileScheduler.reset(frameBuffer.width, frameBuffer.height, int(workers.size()));
+        passFinished.notify_all();
+    }
+    else
+        passFinished.wait(lock, [&] { return passStep < step; });
+    return step / 2;
+}
+
+template <int features>
+void Raytracer::RaytraceTile(const TileScheduler::Tile &tile, int step, bool refining, RenderStats &stats)
+{
+    // the paths only care about the secondary rays
+    constexpr int pathFeatures = features == SHADE_GENERIC ? SHADE_GENERIC : features & ~(SHADE_INTERPOLATION | SHADE_PHONG);
+    int heatmap = renderParameters->heatmapMode;
+
+    for (int j = tile.y0; j < tile.y1; j += step)
+    {
+        // a tile with a lot of glass can take a while, so a restart does not wait for all of it
+        if (restartRaytrace)
+            return;
+        for (int i = tile.x0; i < tile.x1; i += step)
+        {
+            // done by the pass before, at twice the step
+            if (refining && ((i | j) & (2 * step - 1)) == 0)
+                continue;
+
             Ray cameraRay = calculateRay(i, j, !renderParameters->orthoProjection);
 
             Homogeneous4 color = COLOR_black;
+            long costBefore = heatmapCost(stats, heatmap);
 
             // interpoltation coloring
-            Scene::CollisionInfo ci = raytraceScene.closestTriangle(cameraRay);
+            Scene::CollisionInfo ci = raytraceScene.closestTriangle(cameraRay, &stats);
+            stats.primaryRays++;
             if (ci.t > -0.01f)
             {
-                if (renderParameters->interpolationRendering)
+                if (shades<features>(SHADE_INTERPOLATION))
                 {
                     // just normals shading
                     color = interpolatedShading(ci, cameraRay);
                 }
-                else if (renderParameters->phongEnabled)
+                else if (shades<features>(SHADE_PHONG))
                 {
                     // raytracing proper
-                    color = TraceAndShadeWithRay(cameraRay, N_BOUNCES, 1.0f);
+                    color = TraceAndShadeWithRay<pathFeatures>(cameraRay, ci, N_BOUNCES, 1.0f, 1.0f, stats);
                 }
                 else
                 {
                     // no shading, just white if ray hit something
                     // color = Homogeneous4(1.0f, 1.0f, 1.0f, 1.0f);
-                    Cartesian3 material_color = ci.tri.shared_material->diffuse + ci.tri.shared_material->emissive;
+                    Material *material = raytraceScene.hitMaterial(ci);
+                    Cartesian3 material_color = material->diffuse + material->emissive;
                     color = Homogeneous4(material_color.x, material_color.y, material_color.z, 1.0f);
                 }
             }
@@ -122,396 +330,214 @@ void Raytracer::RaytraceThread()
             color.y = std::clamp(color.y, 0.0f, 1.0f);
             color.z = std::clamp(color.z, 0.0f, 1.0f);
 
-            // set the color
-            frameBuffer[j][i] = RGBAValue{linear_to_srgb(color.x), linear_to_srgb(color.y), linear_to_srgb(color.z), 255};
+            // set the color, over the whole block on a coarse pass. The heatmap
+            // counts every ray of the pixel, primary, secondary and shadow
+            RGBAValue value{linear_to_srgb(color.x), linear_to_srgb(color.y), linear_to_srgb(color.z), 255};
+            if (heatmap != HEATMAP_OFF)
+                value = heatmapColor(heatmapCost(stats, heatmap) - costBefore, heatmap);
+            for (int y = j; y < std::min(j + step, tile.y1); y++)
+                for (int x = i; x < std::min(i + step, tile.x1); x++)
+                    frameBuffer[y][x] = value;
         }
+    }
+}
 
-        if (restartRaytrace)
+template <int features>
+Homogeneous4 Raytracer::TraceAndShadeWithRay(const Ray &r, const Scene::CollisionInfo &hit, int bounces, float reflectionFactor, float currentIOR, RenderStats &stats)
+{
+    // every secondary ray has one bounce less, so a path is at most N_BOUNCES + 1 segments
+    // deep and the stack lives here rather than on the heap
+    PathSegment path[N_BOUNCES + 1];
+    int depth = 0;
+    startSegment<features>(path[0], r, hit, std::min(bounces, N_BOUNCES), reflectionFactor, currentIOR);
+
+    while (true)
+    {
+        PathSegment &s = path[depth];
+        while (s.next < SECONDARY_COUNT && !s.needed[s.next])
+            s.next++;
+
+        if (s.next < SECONDARY_COUNT)
         {
-            raytracingRunning = false;
-            return;
+            // follow the next secondary ray, one traversal for the whole segment
+            const Ray &secondary = s.secondary[s.next];
+            startSegment<features>(path[depth + 1], secondary, raytraceScene.closestTriangle(secondary, &stats), s.bounces - 1, s.secondaryFactor[s.next], s.secondaryIOR[s.next]);
+            stats.secondaryRays++;
+            depth++;
+            stats.maxDepth = std::max(stats.maxDepth, depth);
+            continue;
         }
+
+        Homogeneous4 color = shadeSegment<features>(s, stats);
+        if (depth == 0)
+            return color;
+
+        // hand the colour back to the segment that spawned this one
+        float t = s.hit.t;
+        depth--;
+        PathSegment &parent = path[depth];
+        parent.secondaryColor[parent.next] = color;
+        parent.secondaryT[parent.next] = t;
+        parent.next++;
     }
-    raytracingRunning = false;
 }
 
-Homogeneous4 Raytracer::TraceAndShadeWithRay(Ray r, int bounces, float reflectionFactor, float currentIOR)
+template <int features>
+void Raytracer::startSegment(PathSegment &s, const Ray &r, const Scene::CollisionInfo &hit, int bounces, float reflectionFactor, float currentIOR)
 {
-    // helper flags for raytracing
-    bool refract = renderParameters->refractionEnabled;
-    bool fresnel = renderParameters->fresnelRendering;
-
-    Scene::CollisionInfo ci = raytraceScene.closestTriangle(r);
-
-    if (ci.t > -0.01f)
+    s.ray = r;
+    s.bounces = bounces;
+    s.reflectionFactor = reflectionFactor;
+    s.currentIOR = currentIOR;
+    s.hit = hit;
+    s.next = 0;
+    for (int i = 0; i < SECONDARY_COUNT; i++)
+        s.needed[i] = false;
+
+    if (hit.t <= -0.01f)
+        return;
+
+    Material *material = raytraceScene.hitMaterial(hit);
+    s.material = material;
+    s.normal = raytraceScene.hitNormal(hit).unit();
+    s.point = raytraceScene.hitPoint(hit);
+
+    // with no lights nothing is shaded, so there is nothing to trace either
+    if (raytraceScene.lights.empty() || bounces <= 0)
+        return;
+
+    if (shades<features>(SHADE_REFLECTION) && material->reflectivity > 0.0f)
     {
-        // this the shared bit
-        Cartesian3 o = r.origin + r.direction * ci.t;
-        Cartesian3 bc = ci.tri.baricentric(o);
-
-        Homogeneous4 phongColor = ci.tri.shared_material->emissive;
+        s.needed[SECONDARY_REFLECTION] = true;
+        s.secondary[SECONDARY_REFLECTION] = reflectRay(s.ray, s.normal, s.point + s.normal * SURFACE_EPSILON);
+        s.secondaryFactor[SECONDARY_REFLECTION] = reflectionFactor * material->reflectivity;
+        s.secondaryIOR[SECONDARY_REFLECTION] = 1.0f;
+    }
 
-        Cartesian3 Na = ci.tri.normals[0].Vector();
-        Cartesian3 Nb = ci.tri.normals[1].Vector();
-        Cartesian3 Nc = ci.tri.normals[2].Vector();
-        Cartesian3 normal = (Na * bc.x + Nb * bc.y + Nc * bc.z).unit();
+    if (shades<features>(SHADE_REFRACTION) && material->transparency > 0.0f)
+    {
+        float ior = material->indexOfRefraction;
+        Cartesian3 direction;
+        // refractRay moves the point to the side the new ray starts from
+        s.refractedPoint = s.point;
+        s.isRefracted = refractRay(s.ray, s.refractedPoint, s.normal, ior, direction);
 
-        Cartesian3 currentPoint = ci.tri.verts[0].Point() * bc.x + ci.tri.verts[1].Point() * bc.y + ci.tri.verts[2].Point() * bc.z;
+        float cosTheta = fabs(r.direction.dot(s.normal));
+        s.fresnelReflectance = schlickApproximation(cosTheta, currentIOR, ior);
 
-        for (Light *l : renderParameters->lights)
+        if (shades<features>(SHADE_FRESNEL) && material->reflectivity > 0.0f)
         {
-            Cartesian3 currentPoint = ci.tri.verts[0].Point() * bc.x + ci.tri.verts[1].Point() * bc.y + ci.tri.verts[2].Point() * bc.z;
-
-            if (renderParameters->shadowsEnabled)
-            {
+            s.needed[SECONDARY_FRESNEL] = true;
+            s.secondary[SECONDARY_FRESNEL] = reflectRay(s.ray, s.normal, s.refractedPoint + s.normal * SURFACE_EPSILON);
+            s.secondaryFactor[SECONDARY_FRESNEL] = reflectionFactor * material->reflectivity;
+            s.secondaryIOR[SECONDARY_FRESNEL] = ior;
+        }
 
-                Matrix4 modelview = raytraceScene.getModelview();
-                Homogeneous4 lightPos = modelview * l->GetPositionCenter();
-                Homogeneous4 lightColor = l->GetColor();
+        if (s.isRefracted)
+        {
+            s.needed[SECONDARY_REFRACTION] = true;
+            s.secondary[SECONDARY_REFRACTION] = Ray(s.refractedPoint, direction, Ray::secondary);
+            s.secondaryFactor[SECONDARY_REFRACTION] = reflectionFactor * material->reflectivity;
+            s.secondaryIOR[SECONDARY_REFRACTION] = ior;
+        }
+    }
+}
 
-                // for this light, are we in shadow?
-                float epsilon = 0.01f;
-                Cartesian3 lp = raytraceScene.getModelview() * l->GetPositionCenter().Point();
-                Ray shadowRay = Ray((currentPoint + epsilon * normal), (lp - currentPoint).unit(), Ray::secondary);
+template <int features>
+Homogeneous4 Raytracer::shadeSegment(const PathSegment &s, RenderStats &stats)
+{
+    if (s.hit.t <= -0.01f)
+    {
+        // no intersection
+        return COLOR_black;
+    }
 
-                Scene::CollisionInfo ci_shadow = raytraceScene.closestTriangle(shadowRay);
+    bool shadows = shades<features>(SHADE_SHADOWS);
+    bool reflection = shades<features>(SHADE_REFLECTION);
+    bool refraction = shades<features>(SHADE_REFRACTION);
 
-                if (ci_shadow.t > 0.0f && ci_shadow.tri.isValid() && !ci_shadow.tri.shared_material->isLight())
-                {
-                    // we are in shadow
-                    Homogeneous4 ambient = ci.tri.shadowShading(l->GetColor());
-                    phongColor = phongColor + ambient;
-                }
-                else
-                {
-                    // we are not in shadow
-                    phongColor = phongColor + ci.tri.phongShading(lightPos, lightColor, bc);
-                }
-                if (renderParameters->reflectionEnabled)
-                {
-                    if (ci.tri.shared_material->reflectivity > 0.0f)
-                    {
-                        if (bounces > 0)
-                        {
-                            // reflection
-                            Ray reflectedRay = reflectRay(r, normal, currentPoint + normal * 0.001f);
-                            Homogeneous4 reflectedColor = TraceAndShadeWithRay(reflectedRay, bounces - 1, reflectionFactor * ci.tri.shared_material->reflectivity);
-                            phongColor = (phongColor * (1 - ci.tri.shared_material->reflectivity) + reflectedColor) * reflectionFactor;
-                            // phongColor = phongColor * (1 - ci.tri.shared_material->transparency);
-                            if (refract)
-                            {
-                                phongColor = phongColor * (1 - ci.tri.shared_material->transparency);
-                            }
-                        }
-                        else if (bounces == 0)
-                        {
-                            // no more bounces
-                            phongColor = COLOR_black;
-                        }
-                    }
-                }
+    const Material *material = s.material;
+    Homogeneous4 phongColor = material->emissive;
 
-                if (renderParameters->refractionEnabled)
-                {
+    for (const Scene::SceneLight &light : raytraceScene.lights)
+    {
+        if (shadows)
+        {
+            // for this light, are we in shadow?
+            stats.shadowRays++;
+            if (raytraceScene.occluded(raytraceScene.shadowRay(s.point, s.normal, light), &stats))
+                phongColor = phongColor + material->shadowShading(light.color);
+            else
+                phongColor = phongColor + material->phongShading(light.position, light.color, s.point, s.normal, raytraceScene.eyePosition);
+        }
+        else if (reflection)
+        {
+            phongColor = phongColor + material->phongShading(light.position, light.color, s.point, s.normal, raytraceScene.eyePosition);
+        }
 
-                    if (ci.tri.shared_material->transparency > 0.0f)
-                    {
-                        if (bounces > 0)
-                        {
-
-                            float ior = ci.tri.shared_material->indexOfRefraction;
-                            Cartesian3 direction;
-                            bool isRefracted = refractRay(r, currentPoint, normal, ior, direction);
-
-                            float cosTheta = fabs(r.direction.dot(normal));
-                            float fresnelReflectance = schlickApproximation(cosTheta, currentIOR, ior);
-
-                            Homogeneous4 reflectionColor = COLOR_black;
-
-                            if (fresnel)
-                            {
-                                if (bounces == 0)
-                                    return phongColor;
-                                if (ci.tri.shared_material->reflectivity > 0.0f)
-                                {
-                                    Ray reflectedRay = reflectRay(r, normal, currentPoint + normal * 0.001f);
-                                    reflectionColor = TraceAndShadeWithRay(reflectedRay, bounces - 1, reflectionFactor * ci.tri.shared_material->reflectivity, ior);
-                                }
-                            }
-
-                            if (isRefracted) // refraction
-                            {
-                                if (bounces == 0)
-                                    return phongColor;
-                                // phongColor = COLOR_magenta;
-                                Ray refractedRay = Ray(currentPoint, direction, Ray::secondary);
-                                // what does this ray hit?
-                                Homogeneous4 refractionColor = TraceAndShadeWithRay(refractedRay, bounces - 1, reflectionFactor * ci.tri.shared_material->reflectivity, ior);
-
-                                
-
-                                Cartesian3 diffuse = ci.tri.shared_material->diffuse;
-                                // std::cout << ci.tri.shared_material->name << std::endl;
-                                Scene::CollisionInfo ab_coll = raytraceScene.closestTriangle(refractedRay);
-                                Cartesian3 ab_o = refractedRay.origin + refractedRay.direction * ab_coll.t;
-                                Cartesian3 ab_bc = ab_coll.tri.baricentric(ab_o);
-                                
-                                Cartesian3 ab_Na = ab_coll.tri.normals[0].Vector();
-                                Cartesian3 ab_Nb = ab_coll.tri.normals[1].Vector();
-                                Cartesian3 ab_Nc = ab_coll.tri.normals[2].Vector();
-                                Cartesian3 ab_normal = (ab_Na * ab_bc.x + ab_Nb * ab_bc.y + ab_Nc * ab_bc.z).unit();
-
-                                float distance = (ab_o - currentPoint).length();
-
-                                Cartesian3 absorption = diffuse * distance;
-
-                                Homogeneous4 absorptionColor = Homogeneous4 (
-                                    exp(absorption.x),
-                                    exp(absorption.y),
-                                    exp(absorption.z),
-                                    1.0f
-                                );
-
-                                refractionColor = absorptionColor.modulate(refractionColor);
-
-
-                                
-
-                                phongColor = fresnelReflectance * reflectionColor + (1.0f - fresnelReflectance) * refractionColor;
-                                // phongColor = fresnelReflectance * reflectionColor + (1.0f - fresnelReflectance) * refractionColor;
-                            }
-                            else // total internal reflection
-                            {
-                                Ray reflectedRay = reflectRay(r, normal, currentPoint);
-                                // Homogeneous4 reflectedColor = TraceAndShadeWithRay(reflectedRay, bounces - 1, reflectionFactor * ci.tri.shared_material->reflectivity, ior);
-                                phongColor = phongColor + reflectionColor;
-                                // phongColor = phongColor + fresnelReflectance * reflectionColor;
-                                // phongColor = phongColor + fresnelReflectance * reflectionColor + (1.0f - fresnelReflectance) * reflectedColor;
-                            }
-                        }
-                        else if (bounces == 0)
-                        {
-                            // no more bounces
-                            // just sanity check the color
-                            phongColor.x = std::clamp(phongColor.x, 0.0f, 1.0f);
-                            phongColor.y = std::clamp(phongColor.y, 0.0f, 1.0f);
-                            phongColor.z = std::clamp(phongColor.z, 0.0f, 1.0f);
-                            return phongColor;
-                        }
-                    }
-
-                    else if (!renderParameters->reflectionEnabled)
-                    {
-                        // this is the color should be shown on the screen
-                        phongColor = phongColor + ci.tri.phongShading(lightPos, lightColor, bc) * (1.0f - ci.tri.shared_material->transparency);
-                    }
-                }
+        if (reflection && material->reflectivity > 0.0f)
+        {
+            if (s.bounces > 0)
+            {
+                phongColor = (phongColor * (1 - material->reflectivity) + s.secondaryColor[SECONDARY_REFLECTION]) * s.reflectionFactor;
+                if (refraction)
+                    phongColor = phongColor * (1 - material->transparency);
+            }
+            else
+            {
+                // no more bounces
+                phongColor = COLOR_black;
             }
+        }
 
-            else // shadows are disabled
+        if (refraction)
+        {
+            if (material->transparency > 0.0f)
             {
-                // shadows are disabled
-                Matrix4 modelview = raytraceScene.getModelview();
-                Homogeneous4 lightPos = modelview * l->GetPositionCenter();
-                Homogeneous4 lightColor = l->GetColor();
+                // no more bounces, the colour so far is all there is
+                if (s.bounces <= 0)
+                    break;
 
-                if (renderParameters->reflectionEnabled)
-                {
-                    phongColor = phongColor + ci.tri.phongShading(lightPos, lightColor, bc);
-
-                    if (ci.tri.shared_material->reflectivity > 0.0f)
-                    {
-                        if (bounces > 0)
-                        {
-                            // reflection
-                            Ray reflectedRay = reflectRay(r, normal, currentPoint + normal * 0.001f);
-                            Homogeneous4 reflectedColor = TraceAndShadeWithRay(reflectedRay, bounces - 1, reflectionFactor * ci.tri.shared_material->reflectivity);
-                            phongColor = (phongColor * (1 - ci.tri.shared_material->reflectivity) + reflectedColor) * reflectionFactor;
-                            // phongColor = phongColor * (1 - ci.tri.shared_material->transparency);
-                            if (refract)
-                            {
-                                phongColor = phongColor * (1 - ci.tri.shared_material->transparency);
-                            }
-                        }
-                        else if (bounces == 0)
-                        {
-                            // no more bounces
-                            // phongColor = phongColor + ci.tri.phongShading(lightPos, lightColor, bc) * (1.0f - ci.tri.shared_material->reflectivity);
-                            phongColor = COLOR_black;
-                            // just sanity check the color
-                            // phongColor.x = std::clamp(phongColor.x, 0.0f, 1.0f);
-                            // phongColor.y = std::clamp(phongColor.y, 0.0f, 1.0f);
-                            // phongColor.z = std::clamp(phongColor.z, 0.0f, 1.0f);
-                            // return phongColor;
-                        }
-                    }
-                    
-                }
+                Homogeneous4 reflectionColor = COLOR_black;
+                if (s.needed[SECONDARY_FRESNEL])
+                    reflectionColor = s.secondaryColor[SECONDARY_FRESNEL];
 
-                if (renderParameters->refractionEnabled)
+                if (s.isRefracted)
                 {
-
-                    if (ci.tri.shared_material->transparency > 0.0f)
-                    {
-                        if (bounces > 0)
-                        {
-
-                            float ior = ci.tri.shared_material->indexOfRefraction;
-                            Cartesian3 direction;
-                            bool isRefracted = refractRay(r, currentPoint, normal, ior, direction);
-
-                            float cosTheta = fabs(r.direction.dot(normal));
-                            float fresnelReflectance = schlickApproximation(cosTheta, currentIOR, ior);
-
-                            Homogeneous4 reflectionColor = COLOR_black;
-
-                            if (fresnel)
-                            {
-                                if (bounces == 0)
-                                    return phongColor;
-                                if (ci.tri.shared_material->reflectivity > 0.0f)
-                                {
-                                    Ray reflectedRay = reflectRay(r, normal, currentPoint + normal * 0.001f);
-                                    reflectionColor = TraceAndShadeWithRay(reflectedRay, bounces - 1, reflectionFactor * ci.tri.shared_material->reflectivity, ior);
-                                }
-                            }
-
-                            if (isRefracted) // refraction
-                            {
-                                if (bounces == 0)
-                                    return phongColor;
-                                // phongColor = COLOR_magenta;
-                                Ray refractedRay = Ray(currentPoint, direction, Ray::secondary);
-                                // what does this ray hit?
-                                Homogeneous4 refractionColor = TraceAndShadeWithRay(refractedRay, bounces - 1, reflectionFactor * ci.tri.shared_material->reflectivity, ior);
-
-                                
-
-                                Cartesian3 diffuse = ci.tri.shared_material->diffuse;
-                                // std::cout << ci.tri.shared_material->name << std::endl;
-                                Scene::CollisionInfo ab_coll = raytraceScene.closestTriangle(refractedRay);
-                                Cartesian3 ab_o = refractedRay.origin + refractedRay.direction * ab_coll.t;
-                                Cartesian3 ab_bc = ab_coll.tri.baricentric(ab_o);
-                                
-                                Cartesian3 ab_Na = ab_coll.tri.normals[0].Vector();
-                                Cartesian3 ab_Nb = ab_coll.tri.normals[1].Vector();
-                                Cartesian3 ab_Nc = ab_coll.tri.normals[2].Vector();
-                                Cartesian3 ab_normal = (ab_Na * ab_bc.x + ab_Nb * ab_bc.y + ab_Nc * ab_bc.z).unit();
-
-                                float distance = (ab_o - currentPoint).length();
-
-                                Cartesian3 absorption = diffuse * distance;
-
-                                Homogeneous4 absorptionColor = Homogeneous4 (
-                                    exp(absorption.x),
-                                    exp(absorption.y),
-                                    exp(absorption.z),
-                                    1.0f
-                                );
-
-                                refractionColor = absorptionColor.modulate(refractionColor);
-
-
-                                
-
-                                phongColor = fresnelReflectance * reflectionColor + (1.0f - fresnelReflectance) * refractionColor;
-                                // phongColor = fresnelReflectance * reflectionColor + (1.0f - fresnelReflectance) * refractionColor;
-                            }
-                            else // total internal reflection
-                            {
-                                Ray reflectedRay = reflectRay(r, normal, currentPoint);
-                                // Homogeneous4 reflectedColor = TraceAndShadeWithRay(reflectedRay, bounces - 1, reflectionFactor * ci.tri.shared_material->reflectivity, ior);
-                                phongColor = phongColor + reflectionColor;
-                                // phongColor = phongColor + fresnelReflectance * reflectionColor;
-                                // phongColor = phongColor + fresnelReflectance * reflectionColor + (1.0f - fresnelReflectance) * reflectedColor;
-                            }
-                        }
-                        else if (bounces == 0)
-                        {
-                            // no more bounces
-                            // just sanity check the color
-                            phongColor.x = std::clamp(phongColor.x, 0.0f, 1.0f);
-                            phongColor.y = std::clamp(phongColor.y, 0.0f, 1.0f);
-                            phongColor.z = std::clamp(phongColor.z, 0.0f, 1.0f);
-                            return phongColor;
-                        }
-                    }
-
-                    else if (!renderParameters->reflectionEnabled)
-                    {
-                        // this is the color should be shown on the screen
-                        phongColor = phongColor + ci.tri.phongShading(lightPos, lightColor, bc) * (1.0f - ci.tri.shared_material->transparency);
-                    }
+                    // light is absorbed along the way through the material,
+                    // up to what the refracted ray hit
+                    const Ray &refractedRay = s.secondary[SECONDARY_REFRACTION];
+                    Cartesian3 exitPoint = refractedRay.origin + refractedRay.direction * s.secondaryT[SECONDARY_REFRACTION];
+                    float distance = (exitPoint - s.refractedPoint).length();
+                    Cartesian3 absorption = material->diffuse * distance;
+                    Homogeneous4 absorptionColor = Homogeneous4(exp(absorption.x), exp(absorption.y), exp(absorption.z), 1.0f);
+                    Homogeneous4 refractionColor = absorptionColor.modulate(s.secondaryColor[SECONDARY_REFRACTION]);
+
+                    phongColor = s.fresnelReflectance * reflectionColor + (1.0f - s.fresnelReflectance) * refractionColor;
                 }
-
-                if (!renderParameters->refractionEnabled && !renderParameters->reflectionEnabled)
+                else // total internal reflection
                 {
-                    // this is the color should be shown on the screen
-                    phongColor = phongColor + ci.tri.phongShading(lightPos, lightColor, bc);
+                    phongColor = phongColor + reflectionColor;
                 }
             }
+            else if (!reflection)
+            {
+                // this is the color should be shown on the screen
+                phongColor = phongColor + material->phongShading(light.position, light.color, s.point, s.normal, raytraceScene.eyePosition) * (1.0f - material->transparency);
+            }
         }
-        // just sanity check the color
-        phongColor.x = std::clamp(phongColor.x, 0.0f, 1.0f);
-        phongColor.y = std::clamp(phongColor.y, 0.0f, 1.0f);
-        phongColor.z = std::clamp(phongColor.z, 0.0f, 1.0f);
-        return phongColor;
-    }
-    else
-    {
-        // no intersection
-        // return COLOR_black;
-        return COLOR_black;
-    }
-}
-
-// float schlickApproximation( float cosTheta, float ior1, float ior2)S
-// {
-//     float R0 = pow((ior1 - ior2) / (ior1 + ior2), 2.0f);
-//     return R0 + (1.0f - R0) * pow(1.0f - cosTheta, 5.0f);
-// }
-
-Homogeneous4 Raytracer::reflectionShading(Ray ray, Cartesian3 normal, Cartesian3 point, Homogeneous4 color, float reflectivity, float reflectionFactor, int bounces)
-{
-    if (reflectivity <= 0.0f)
-        return color;
-
-    if (bounces > 0)
-    {
-        Ray reflectedRay = reflectRay(ray, normal, point);
-        Homogeneous4 reflectedColor = TraceAndShadeWithRay(reflectedRay, bounces - 1, reflectionFactor * reflectivity);
-        color = (color * (1 - reflectivity) + reflectedColor) * reflectionFactor;
-    }
-    else
-        color = COLOR_black;
-
-    return color;
-}
 
-Homogeneous4 Raytracer::shadowShading(Scene::CollisionInfo ci, Light *l, Cartesian3 currentPoint, Cartesian3 normal, Cartesian3 bc, Homogeneous4 phongColor)
-{
-    // for this light, are we in shadow?
-    float epsilon = 0.01f;
-    Cartesian3 lp = raytraceScene.getModelview() * l->GetPositionCenter().Point();
-    Ray shadowRay = Ray((currentPoint + epsilon * normal), (lp - currentPoint).unit(), Ray::secondary);
-
-    Scene::CollisionInfo ci_shadow = raytraceScene.closestTriangle(shadowRay);
-
-    if (ci_shadow.t > 0.0f && ci_shadow.tri.isValid() && !ci_shadow.tri.shared_material->isLight())
-    {
-        // we are in shadow
-        Homogeneous4 ambient = ci.tri.shadowShading(l->GetColor());
-        phongColor = phongColor + ambient;
-    }
-    else
-    {
-        // we are not in shadow
-        Matrix4 modelview = raytraceScene.getModelview();
-        Homogeneous4 lightPos = modelview * l->GetPositionCenter();
-        Homogeneous4 lightColor = l->GetColor();
-        phongColor = phongColor + ci.tri.phongShading(lightPos, lightColor, bc);
+        if (!shadows && !refraction && !reflection)
+        {
+            // this is the color should be shown on the screen
+            phongColor = phongColor + material->phongShading(light.position, light.color, s.point, s.normal, raytraceScene.eyePosition);
+        }
     }
 
+    // just sanity check the color
+    phongColor.x = std::clamp(phongColor.x, 0.0f, 1.0f);
+    phongColor.y = std::clamp(phongColor.y, 0.0f, 1.0f);
+    phongColor.z = std::clamp(phongColor.z, 0.0f, 1.0f);
     return phongColor;
 }
 
@@ -545,13 +571,13 @@ bool Raytracer::refractRay(Ray &incidentRay, Cartesian3 &intersectionPoint, Cart
 
     if (k < 0)
     {
-        intersectionPoint = intersectionPoint + n * 0.001f;
+        intersectionPoint = intersectionPoint + n * SURFACE_EPSILON;
         // total internal reflection
         return false;
     }
     else
     {
-        intersectionPoint = intersectionPoint - n * 0.001f;
+        intersectionPoint = intersectionPoint - n * SURFACE_EPSILON;
         direction = eta * I + (eta * cosi - sqrt(k)) * n;
         // std::cout<<"Refracted direction: "<<direction<<std::endl;
         return true;
@@ -563,16 +589,35 @@ bool Raytracer::refractRay(Ray &incidentRay, Cartesian3 &intersectionPoint, Cart
 // routine that generates the image
 void Raytracer::Raytrace()
 { // RaytraceRenderWidget::Raytrace()
+    TraceScope trace("Raytrace", "frame");
     stopRaytracer();
     // To make our lifes easier, lets calculate things on VCS.
     // So we need to process our scene to get a triangle soup in VCS.
     raytraceScene.updateScene();
     frameBuffer.clear(RGBAValue(0.0f, 0.0f, 0.0f, 1.0f));
-    std::thread raytracingThread(&Raytracer::RaytraceThread, this);
-    raytracingThread.detach();
-    raytracingRunning = true;
+    startFrame();
 } // RaytraceRenderWidget::Raytrace()
 
+void Raytracer::RaytraceBlocking()
+{
+    Raytrace();
+    std::unique_lock<std::mutex> lock(frameLock);
+    frameFinished.wait(lock, [this] { return busyWorkers == 0; });
+}
+
+// the tile kernels, indexed by their SHADE_* features
+template <int... features>
+static constexpr std::array<Raytracer::TileKernel, sizeof...(features)> makeTileKernels(std::integer_sequence<int, features...>)
+{
+    return {{&Raytracer::RaytraceTile<features>...}};
+}
+
+Raytracer::TileKernel Raytracer::tileKernel(int features)
+{
+    static constexpr std::array<TileKernel, SHADE_GENERIC + 1> kernels = makeTileKernels(std::make_integer_sequence<int, SHADE_GENERIC + 1>());
+    return kernels[features];
+}
+
 
 
 Ray Raytracer::calculateRay(int pixelx, int pixely, bool perspective)
@@ -599,7 +644,7 @@ Ray Raytracer::calculateRay(int pixelx, int pixely, bool perspective)
         Cartesian3 origin = Cartesian3(0, 0, 0);
         Cartesian3 direction = Cartesian3(x, y, 1);
 
-        return Ray(origin, direction, Ray::primary);
+        return raytraceScene.fromCamera(Ray(origin, direction, Ray::primary));
     }
     else
     {
@@ -617,21 +662,17 @@ Ray Raytracer::calculateRay(int pixelx, int pixely, bool perspective)
         Cartesian3 direction = Cartesian3(0, 0, 1);
         // direction = origin-direction;
         direction = direction.unit();
-        return Ray(origin, direction, Ray::primary);
+        return raytraceScene.fromCamera(Ray(origin, direction, Ray::primary));
     }
 }
 
 
 
-Homogeneous4 Raytracer::interpolatedShading(Scene::CollisionInfo ci, Ray r)
+Homogeneous4 Raytracer::interpolatedShading(const Scene::CollisionInfo &ci, Ray r)
 {
-    Cartesian3 o = r.origin + r.direction * ci.t;
-    Cartesian3 bc = ci.tri.baricentric(o);
-    Cartesian3 Na = ci.tri.normals[0].Vector();
-    Cartesian3 Nb = ci.tri.normals[1].Vector();
-    Cartesian3 Nc = ci.tri.normals[2].Vector();
-    Cartesian3 normal = Na * bc.x + Nb * bc.y + Nc * bc.z;
-    normal.unit();
+    Cartesian3 normal = raytraceScene.hitNormal(ci);
+    // the colours show the normal as seen from the camera, whatever space we trace in
+    normal = (raytraceScene.sceneToCamera * Homogeneous4(normal.x, normal.y, normal.z, 0.0f)).Vector();
 
     Homogeneous4 color = Homogeneous4(abs(normal.x), abs(normal.y), abs(normal.z), 1.0f);
     return color;
@@ -22,11 +22,15 @@
 #include <vector>
 #include <mutex>
 #include <atomic>
+#include <thread>
+#include <condition_variable>
 
 // and include all of our own headers that we need
 #include "ThreeDModel.h"
 #include "RenderParameters.h"
 #include "Scene.h"
+#include "TileScheduler.h"
+#include "RenderStats.h"
 
 class Raytracer 										
 	{ 
@@ -39,6 +43,8 @@ class Raytracer
 	// An image to use as a framebuffer
     //A friendly Scene representation that we control
     Scene raytraceScene;
+    // shares the tiles of a frame out to the render threads
+    TileScheduler tileScheduler;
 
 	public:
 	// constructor
@@ -54,7 +60,14 @@ class Raytracer
 	~Raytracer();
 	
 	void resize(int w, int h);
+	// cancels the frame being rendered, if any, and returns once the workers let go of it
 	void stopRaytracer();
+	// how long the last cancelled frame took to stop, in milliseconds
+	double restartLatency() const { return lastRestartLatency; }
+	// the work done for the last frame, to be asked once it is finished
+	RenderStats frameStats();
+	// the same, thread by thread
+	std::vector<RenderStats> threadStats();
 	RGBAImage frameBuffer;
 
 	protected:
@@ -63,20 +76,27 @@ class Raytracer
 
 	public:
 
-    // routine that generates the image
+    // routine that generates the image, in the background
     void Raytrace();
-    //threading stuff
-    void RaytraceThread();
+    // the same, but it returns with the frame done
+    void RaytraceBlocking();
+
+    // renders one tile of the frame buffer, every step-th pixel in both directions,
+    // each filling the step x step block below and right of it. When refining, the
+    // pixels the pass before had already done are skipped. There is one for every
+    // combination of SHADE_* features, and one for SHADE_GENERIC, and the frame
+    // picks one up front
+    typedef void (Raytracer::*TileKernel)(const TileScheduler::Tile &tile, int step, bool refining, RenderStats &stats);
+    template <int features> void RaytraceTile(const TileScheduler::Tile &tile, int step, bool refining, RenderStats &stats);
+    static TileKernel tileKernel(int features);
 
 	Ray calculateRay(int pixelx, int pixely, bool perspective);
 
-	Homogeneous4 TraceAndShadeWithRay(Ray r, int bounces, float reflectionFactor, float currentIOR = 1.0f);
+	// the colour along a ray whose closest hit is already known
+	template <int features>
+	Homogeneous4 TraceAndShadeWithRay(const Ray &r, const Scene::CollisionInfo &hit, int bounces, float reflectionFactor, float currentIOR, RenderStats &stats);
 
-	Homogeneous4 reflectionShading(Ray ray, Cartesian3 normal, Cartesian3 point, Homogeneous4 color, float reflectivity, float reflectionFactor, int bounces);
-
-	Homogeneous4 interpolatedShading(Scene::CollisionInfo ci, Ray r);
-
-	Homogeneous4 shadowShading(Scene::CollisionInfo ci, Light* l, Cartesian3 currentPoint, Cartesian3 normal, Cartesian3 bc, Homogeneous4 phongColor);
+	Homogeneous4 interpolatedShading(const Scene::CollisionInfo &ci, Ray r);
 
 	Ray reflectRay(Ray r, Cartesian3 normal, Cartesian3 intersectionPoint);
 
@@ -96,9 +116,85 @@ class Raytracer
 
     private:
 
+	// the secondary rays a hit can spawn
+	enum { SECONDARY_REFLECTION, SECONDARY_FRESNEL, SECONDARY_REFRACTION, SECONDARY_COUNT };
+
+	// one hit along a path. The paths are followed with a stack of these
+	// instead of recursion: the secondary rays of a hit are traced first,
+	// once each, and the hit is shaded when their colours are back
+	struct PathSegment
+	{
+		Ray ray;
+		int bounces;
+		float reflectionFactor;
+		float currentIOR;
+		Scene::CollisionInfo hit;
+
+		// the shading inputs at the hit
+		Material *material;
+		Cartesian3 normal;
+		Cartesian3 point;
+		// for a transparent hit: the point moved through (or off) the surface,
+		// and how much is reflected
+		Cartesian3 refractedPoint;
+		bool isRefracted;
+		float fresnelReflectance;
+
+		// the secondary rays, their colours and the distance to what they hit
+		bool needed[SECONDARY_COUNT];
+		Ray secondary[SECONDARY_COUNT];
+		float secondaryFactor[SECONDARY_COUNT];
+		float secondaryIOR[SECONDARY_COUNT];
+		Homogeneous4 secondaryColor[SECONDARY_COUNT];
+		float secondaryT[SECONDARY_COUNT];
+		// the next one to trace
+		int next;
+	};
+
+	// whether a SHADE_* feature is on. Known at compile time, but for SHADE_GENERIC
+	template <int features> bool shades(int feature) const;
+	// fills in a segment for a ray and its closest hit, and works out its secondary rays
+	template <int features>
+	void startSegment(PathSegment &s, const Ray &r, const Scene::CollisionInfo &hit, int bounces, float reflectionFactor, float currentIOR);
+	// the colour of a segment, once its secondary rays are traced
+	template <int features>
+	Homogeneous4 shadeSegment(const PathSegment &s, RenderStats &stats);
+
 	std::atomic<bool> raytracingRunning;
 	std::atomic<bool> restartRaytrace;
 
+	// the render threads live as long as the Raytracer. They sleep until a
+	// frame is started, and then work through its tiles together
+	std::vector<std::thread> workers;
+	void RenderWorker(int worker);
+	// hands the current frame to the workers
+	void startFrame();
+	// waits for the other workers to finish the pass with this step, and returns the next step
+	int finishPass(int step);
+	// guards everything below
+	std::mutex frameLock;
+	// the workers wait on frameStarted, stopRaytracer and RaytraceBlocking on frameFinished
+	std::condition_variable frameStarted;
+	std::condition_variable frameFinished;
+	std::condition_variable passFinished;
+	// counts the frames started, so a worker knows when there is a new one
+	unsigned long frameNumber;
+	// the workers not done with the current frame yet, and with the current pass
+	int busyWorkers;
+	int passWorkers;
+	// the pixel step of the first pass of the frame, and of the current one
+	int firstStep;
+	int passStep;
+	bool shuttingDown;
+	// the kernel the current frame is rendered with
+	TileKernel frameKernel;
+	// what each worker did this frame, on a cache line of its own
+	struct alignas(64) WorkerStats{
+		RenderStats stats;
+	};
+	std::vector<WorkerStats> workerStats;
+	double lastRestartLatency;
+
 	}; // class RaytraceRenderWidget
 
 #endif
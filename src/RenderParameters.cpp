@@ -150,6 +150,25 @@ Matrix4 RenderParameters::getViewMatrix()
     return  RotateMatrix * TranslateMatrix;
 }
 
+void RenderParameters::setShadingFeatures(int features)
+{
+    interpolationRendering = features & SHADE_INTERPOLATION;
+    phongEnabled = features & SHADE_PHONG;
+    shadowsEnabled = features & SHADE_SHADOWS;
+    reflectionEnabled = features & SHADE_REFLECTION;
+    refractionEnabled = features & SHADE_REFRACTION;
+    fresnelRendering = features & SHADE_FRESNEL;
+}
+
+std::string RenderParameters::shadingFeatureName(int features)
+{
+    std::string name;
+    for (int bit = 0; bit < SHADE_FEATURE_COUNT; bit++)
+        if (features & (1 << bit))
+            name += (name.empty() ? "" : "+") + std::string(shadingFeatureNames[bit]);
+    return name.empty() ? "flat" : name;
+}
+
 void RenderParameters::printSettings() 
 {
     cout << "Interpolation " << interpolationRendering << endl;
@@ -160,6 +179,16 @@ void RenderParameters::printSettings()
     cout << "Fresnel " << fresnelRendering << endl;
     cout << "monteCarloEnabled " << monteCarloEnabled << endl;
     cout << "Ortho " << orthoProjection << endl;
+    cout << "BVH " << bvhEnabled << endl;
+    cout << "World space " << worldSpaceRendering << endl;
+    const char *layoutNames[BVH_LAYOUT_COUNT] = {"binary", "wide", "compressed"};
+    cout << "BVH layout " << layoutNames[bvhLayout] << endl;
+    cout << "Specialized shading " << specializedShading << endl;
+    cout << "Progressive " << progressiveRendering << endl;
+    cout << "Stats " << statsEnabled << endl;
+    const char *heatmapNames[HEATMAP_COUNT] = {"off", "nodes visited", "triangle tests"};
+    cout << "Heatmap " << heatmapNames[heatmapMode] << endl;
+    cout << "Trace " << tracingEnabled << endl;
     cout << "====================================" << endl;
 }
 
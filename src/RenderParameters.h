@@ -29,6 +29,7 @@
 class ThreeDModel;
 #include "ThreeDModel.h"
 #include <numbers>
+#include <string>
 #include <cstddef> 
 
 #define BIT_FW 1
@@ -40,6 +41,32 @@ class ThreeDModel;
 #define BIT_LEFTMOUSE 64
 #define BIT_RIGHTMOUSE 128
 
+// node layouts of the acceleration structures, see bvhLayout
+#define BVH_LAYOUT_BINARY 0
+#define BVH_LAYOUT_WIDE 1
+#define BVH_LAYOUT_COMPRESSED 2
+#define BVH_LAYOUT_COUNT 3
+
+// shading features as a bit mask, see shadingFeatures. The raytracer has a
+// kernel compiled for every combination
+#define SHADE_INTERPOLATION 1
+#define SHADE_PHONG 2
+#define SHADE_SHADOWS 4
+#define SHADE_REFLECTION 8
+#define SHADE_REFRACTION 16
+#define SHADE_FRESNEL 32
+#define SHADE_COMBINATIONS 64
+#define SHADE_FEATURE_COUNT 6
+// the kernel that reads the flags as it goes instead
+#define SHADE_GENERIC SHADE_COMBINATIONS
+
+// what the heatmap colours each pixel by, instead of shading it:
+// the BVH nodes or the triangles its rays went through
+#define HEATMAP_OFF 0
+#define HEATMAP_NODES 1
+#define HEATMAP_TESTS 2
+#define HEATMAP_COUNT 3
+
 // class for the render parameters
 class RenderParameters
     { // class RenderParameters
@@ -63,6 +90,20 @@ class RenderParameters
     bool monteCarloEnabled;
     bool centreObject;
     bool orthoProjection;
+    bool bvhEnabled;
+    bool worldSpaceRendering;
+    // which BVH_LAYOUT_* is traversed when bvhEnabled
+    int bvhLayout;
+    // render with the kernel compiled for the current flags, or the generic one
+    bool specializedShading;
+    // show a coarse image first and refine it, or go straight to full resolution
+    bool progressiveRendering;
+    // print the rays and traversal work of every finished frame
+    bool statsEnabled;
+    // which HEATMAP_* is shown
+    int heatmapMode;
+    // record a timeline of the threads, written out when it is turned off
+    bool tracingEnabled;
 
     
     Cartesian3 ModelPosition;
@@ -81,6 +122,28 @@ class RenderParameters
     void computeMatricesFromInputs(float deltaTime, std::byte movementKeys);
     void findLights(std::vector<ThreeDModel> objects);
     void printSettings();
+    // the shading flags as SHADE_* bits
+    int shadingFeatures() const
+    {
+        return (interpolationRendering ? SHADE_INTERPOLATION : 0) | (phongEnabled ? SHADE_PHONG : 0) |
+               (shadowsEnabled ? SHADE_SHADOWS : 0) | (reflectionEnabled ? SHADE_REFLECTION : 0) |
+               (refractionEnabled ? SHADE_REFRACTION : 0) | (fresnelRendering ? SHADE_FRESNEL : 0);
+    }
+    // sets the shading flags from SHADE_* bits
+    void setShadingFeatures(int features);
+    // "phong+shadows" and so on, "flat" without any
+    static std::string shadingFeatureName(int features);
+    // the name of each SHADE_* bit, lowest first
+    static constexpr const char *shadingFeatureNames[SHADE_FEATURE_COUNT] = {"interpolation", "phong", "shadows", "reflection", "refraction", "fresnel"};
+    // the feature sets the bench and regression tools render every scene with
+    static constexpr int shadingPresets[] = {
+        0,
+        SHADE_INTERPOLATION,
+        SHADE_PHONG,
+        SHADE_PHONG | SHADE_SHADOWS,
+        SHADE_PHONG | SHADE_SHADOWS | SHADE_REFLECTION,
+        SHADE_PHONG | SHADE_SHADOWS | SHADE_REFLECTION | SHADE_REFRACTION | SHADE_FRESNEL,
+    };
     
 
     // constructor
@@ -97,6 +160,14 @@ class RenderParameters
         monteCarloEnabled(false),
         centreObject(false),
         orthoProjection(false),
+        bvhEnabled(true),
+        worldSpaceRendering(false),
+        bvhLayout(BVH_LAYOUT_BINARY),
+        specializedShading(true),
+        progressiveRendering(true),
+        statsEnabled(false),
+        heatmapMode(HEATMAP_OFF),
+        tracingEnabled(false),
         // speed (0.1f),
         speed (0.05f),
         near(0.1f),
@@ -0,0 +1,43 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  University of Leeds
+//  COMP 5892M Advanced Rendering
+//  User Interface for Coursework
+////////////////////////////////////////////////////////////////////////
+
+#include "RenderStats.h"
+
+void RenderStats::print(std::ostream &out) const
+{
+    // per ray, so scenes and flags of different sizes compare
+    double perRay = rays() > 0 ? 1.0 / double(rays()) : 0.0;
+    out << "Primary rays " << primaryRays << std::endl;
+    out << "Secondary rays " << secondaryRays << std::endl;
+    out << "Shadow rays " << shadowRays << std::endl;
+    out << "Nodes visited " << nodesVisited << " (" << double(nodesVisited) * perRay << " per ray)" << std::endl;
+    out << "Triangle tests " << triangleTests << " (" << double(triangleTests) * perRay << " per ray)" << std::endl;
+    out << "Deepest path " << maxDepth << " bounces" << std::endl;
+}
+
+void RenderStats::writeJson(std::ostream &out) const
+{
+    out << "{\"primaryRays\":" << primaryRays << ",\"secondaryRays\":" << secondaryRays << ",\"shadowRays\":" << shadowRays
+        << ",\"nodesVisited\":" << nodesVisited << ",\"triangleTests\":" << triangleTests << ",\"maxDepth\":" << maxDepth << "}";
+}
+
+void RenderStats::writeJson(std::ostream &out, const std::vector<RenderStats> &threads)
+{
+    RenderStats total;
+    for (const RenderStats &thread : threads)
+        total += thread;
+    out << "{\"total\":";
+    total.writeJson(out);
+    out << ",\"threads\":[";
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        if (i > 0)
+            out << ",";
+        threads[i].writeJson(out);
+    }
+    out << "]}";
+}
@@ -0,0 +1,62 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  University of Leeds
+//  COMP 5892M Advanced Rendering
+//  User Interface for Coursework
+//
+//  September, 2022
+//
+//  ------------------------
+//  RenderStats.h
+//  ------------------------
+//
+//  Counts of the work done to render a frame. Every render thread keeps
+//  its own, with plain increments, and they are added up when the frame
+//  is over. The traversal counts come back from Scene through a pointer,
+//  which is null wherever nobody is counting.
+//
+///////////////////////////////////////////////////
+
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <algorithm>
+#include <ostream>
+#include <vector>
+
+struct RenderStats
+{
+    // camera rays, reflected and refracted rays, and shadow rays traced
+    long primaryRays = 0;
+    long secondaryRays = 0;
+    long shadowRays = 0;
+    // BVH nodes visited, inner nodes and leaves of the top level and the meshes
+    long nodesVisited = 0;
+    // ray-triangle tests, the triangles of every TrianglePacket tested.
+    // The empty lanes of a packet are not counted
+    long triangleTests = 0;
+    // the most bounces any path followed
+    int maxDepth = 0;
+
+    RenderStats &operator+=(const RenderStats &other)
+    {
+        primaryRays += other.primaryRays;
+        secondaryRays += other.secondaryRays;
+        shadowRays += other.shadowRays;
+        nodesVisited += other.nodesVisited;
+        triangleTests += other.triangleTests;
+        maxDepth = std::max(maxDepth, other.maxDepth);
+        return *this;
+    }
+
+    long rays() const { return primaryRays + secondaryRays + shadowRays; }
+
+    // the counts of a frame in a few lines, next to RenderParameters::printSettings
+    void print(std::ostream &out) const;
+    // the counts as a JSON object
+    void writeJson(std::ostream &out) const;
+    // the sum of every thread's counts, and each thread's own, as a JSON object
+    static void writeJson(std::ostream &out, const std::vector<RenderStats> &threads);
+};
+
+#endif // RENDER_STATS_H
@@ -1,5 +1,11 @@
 #include "Scene.h"
 #include <limits>
+#include "TraceRecorder.h"
+
+// meshes with more triangles than this are built alone, using every thread
+#define SCENE_PARALLEL_MESH_THRESHOLD 4096
+// shadow rays start this far off the surface along the normal
+#define SHADOW_EPSILON 0.01f
 
 Scene::Scene(std::vector<ThreeDModel> *texobjs,RenderParameters *renderp)
 {
@@ -20,120 +26,335 @@ Matrix4 Scene::getModelview()
     return rp->getViewMatrix() * rp->getModelMatrix();
 }
 
-//updateScene will build the scene like we would do for
-//rasterization. So very similar to "Render", but instead
-//of calling glVertex3f, and instead of GL_TRIANGLES, we
-//create triangles. We however need to transform things
-//to VCS to raytrace, as there is no transform phase to do that
-//for us.
-void Scene::updateScene()
+Matrix4 Scene::getSceneTransform()
 {
-    triangles.clear();
-    int triID = 0;
-    //We go through all the objects to construct the scene
-    for (int i = 0;i< int(objects->size());i++)
-    {
-        typedef unsigned int uint;
-        ThreeDModel obj = objects->at(uint(i));
-        // Scale defaults to the zoom setting
-
-        //This object may have a material. But if it does not, lets use from sliders.
-
-        // loop through the faces: note that they may not be triangles, which complicates life
-        for (unsigned int face = 0; face < obj.faceVertices.size(); face++)
-        { // per face
-            // on each face, treat it as a triangle fan starting with the first vertex on the face
-            for (unsigned int triangle = 0; triangle < obj.faceVertices[face].size() - 2; triangle++)
-            { // per triangle
-                // now do a loop over three vertices
-                Triangle t;
-                for (unsigned int vertex = 0; vertex < 3; vertex++)
-                { // per vertex
-                    // we always use the face's vertex 0
-                    uint faceVertex = 0;
-                    // so if it isn't 0, we want to add the triangle base ID
-                    if (vertex != 0)
-                        faceVertex = triangle + vertex;
-
-                    //this is our vertex before any transformations. (world space)
-                    Homogeneous4 v =  Homogeneous4(
-                                obj.vertices[obj.faceVertices   [face][faceVertex]].x,
-                            obj.vertices[obj.faceVertices   [face][faceVertex]].y,
-                            obj.vertices[obj.faceVertices   [face][faceVertex]].z
-                            );
-                    //order of transformations
-                    //- sliders
-                    //- arcball
-                    //- center
-
-                    v = getModelview()*v;
-                    t.verts[vertex] = v;
-
-                    Homogeneous4 n =  Homogeneous4(
-                                obj.normals[obj.faceNormals   [face][faceVertex]].x,
-                            obj.normals[obj.faceNormals   [face][faceVertex]].y,
-                            obj.normals[obj.faceNormals   [face][faceVertex]].z,
-                            0.0f);
-
-                    n = getModelview()*n;
-                    t.normals[vertex] = n;
-
-                    Cartesian3 tex = Cartesian3(
-                                obj.textureCoords[obj.faceTexCoords[face][faceVertex]].x,
-                            obj.textureCoords[obj.faceTexCoords[face][faceVertex]].y,
-                            0.0f
-                            );
-                    t.uvs[vertex] = tex;
-
-
-                    t.colors[vertex] = Cartesian3( 0.7f, 0.7f, 0.7f);
-
-                } // per vertex
-                t.validate(triID++);
-                if(obj.material== nullptr){
-                    t.shared_material = default_mat;
-                }else{
-                    t.shared_material = obj.material;
-                }
-                triangles.push_back(t);
-            } // per triangle
-        } // per face
-    }//per object
+    if (worldSpace)
+        return rp->getModelMatrix();
+    return getModelview();
 }
 
-Scene::CollisionInfo Scene::closestTriangle (Ray r)
+Ray Scene::fromCamera(const Ray &r)
 {
-    //TODO: method to find the closest triangle!
-    Scene::CollisionInfo ci;
-    float mint = std::numeric_limits<float>::max();
-    Triangle tri;
+    if (!worldSpace)
+        return r;
+    Homogeneous4 o = cameraToScene * Homogeneous4(r.origin);
+    Homogeneous4 d = cameraToScene * Homogeneous4(r.direction.x, r.direction.y, r.direction.z, 0.0f);
+    return Ray(o.Point(), d.Vector(), r.ray_type, r.tMin, r.tMax);
+}
+
+//buildMeshes turns every object into a Mesh, very similar to
+//"Render", but instead of calling glVertex3f, and instead of
+//GL_TRIANGLES, we create triangles. They stay in object space:
+//rays are moved into each instance instead, so there is nothing
+//to redo when the camera moves.
+//Only the meshes in rebuild are redone, the others are kept as they are.
+void Scene::buildMeshes(const std::vector<int> &rebuild)
+{
+    TraceScope trace("buildMeshes", "scene");
+    trace.arg("meshes", long(rebuild.size()));
+
+    //the triangle ids run on from object to object, so every mesh knows
+    //where its own start before any of them is built
+    std::vector<int> firstID(objects->size() + 1, 0);
+    for (size_t i = 0; i < objects->size(); i++)
+        firstID[i + 1] = firstID[i] + int(objects->at(i).triangleCount());
 
-    // printf("triangles.size() %lu\n",triangles.size());
+    auto buildMesh = [&](int i)
+    {
+        int triID = firstID[i];
+        meshes[i].clear();
+        meshes[i].addModel(objects->at(i), default_mat, triID);
+        meshes[i].build(rp->bvhEnabled, rp->bvhLayout);
+        meshVersions[i] = objects->at(i).version;
+        return size_t(meshes[i].triangleCount());
+    };
 
-    // interate the list of triangles in the current scene
-    for (size_t i = 0 ; i < triangles.size() ; i++)
+    //big meshes are built one after the other, each with all the threads for
+    //its own parallel build. The small ones get one thread per mesh
+    std::vector<int> smallMeshes;
+    size_t triangleCount = 0;
+    for (int i : rebuild)
     {
+        if (objects->at(i).triangleCount() > SCENE_PARALLEL_MESH_THRESHOLD)
+            triangleCount += buildMesh(i);
+        else
+            smallMeshes.push_back(i);
+    }
+    #pragma omp parallel for schedule(dynamic) reduction(+:triangleCount) if(smallMeshes.size() > 1)
+    for (int r = 0; r < int(smallMeshes.size()); r++)
+        triangleCount += buildMesh(smallMeshes[r]);
+    meshesUseBVH = rp->bvhEnabled;
+    meshesLayout = rp->bvhLayout;
+    topLevelDirty = true;
+    trace.arg("triangles", long(triangleCount));
+}
 
-        float t = triangles[i].intersect(r);
-        if (t <= 0.0f)
+int Scene::addInstance(int mesh, const Matrix4 &placement)
+{
+    Instance instance;
+    instance.mesh = mesh;
+    instance.placement = placement;
+    instance.normalPlacement = placement.invert().transpose();
+    Matrix4 identity;
+    identity.SetIdentity();
+    instance.scalesNormals = !(placement == identity);
+    instances.push_back(instance);
+    topLevelDirty = true;
+    return int(instances.size()) - 1;
+}
+
+//updateScene gets the scene ready for a frame. We need things in
+//a common space to raytrace, as there is no transform phase to do
+//that for us, so each instance gets the model to scene transform
+//and the top level is rebuilt over the instance bounds. The lights
+//are moved into scene space here too, once per frame.
+//In VCS that is the modelview, so any camera move means a new top
+//level. In world space it is only the model matrix, and a camera
+//move only changes the camera rays.
+void Scene::updateScene()
+{
+    TraceScope trace("updateScene", "scene");
+    //a different set of objects, or a different BVH, means every mesh is redone.
+    //Otherwise only the objects whose geometry changed since their mesh was built
+    std::vector<int> rebuild;
+    bool newObjects = meshes.size() != objects->size();
+    bool everything = newObjects || meshesUseBVH != rp->bvhEnabled || meshesLayout != rp->bvhLayout;
+    //an object that gained or lost all its faces changes the object instances too
+    bool newInstances = newObjects;
+    for (size_t i = 0; i < objects->size() && !newObjects; i++)
+    {
+        if (meshVersions[i] == objects->at(i).version && !everything)
             continue;
-        else if (t < mint)
+        rebuild.push_back(int(i));
+        if ((objects->at(i).triangleCount() > 0) != (meshes[i].triangleCount() > 0))
+            newInstances = true;
+    }
+    if (newObjects)
+    {
+        rebuild.clear();
+        meshes.clear();
+        meshes.resize(objects->size());
+        meshVersions.assign(objects->size(), 0);
+        for (size_t i = 0; i < objects->size(); i++)
+            rebuild.push_back(int(i));
+        //the mesh indices of the added instances mean nothing any more
+        instances.clear();
+        objectInstances = 0;
+    }
+    if (newInstances)
+    {
+        //one identity instance per object with faces, ahead of the added ones.
+        //An object without faces has nothing to hit
+        Matrix4 identity;
+        identity.SetIdentity();
+        std::vector<Instance> added(instances.begin() + objectInstances, instances.end());
+        instances.clear();
+        for (size_t i = 0; i < objects->size(); i++)
+            if (objects->at(i).triangleCount() > 0)
+                addInstance(int(i), identity);
+        objectInstances = int(instances.size());
+        instances.insert(instances.end(), added.begin(), added.end());
+    }
+    if (!rebuild.empty())
+        buildMeshes(rebuild);
+
+    worldSpace = rp->worldSpaceRendering;
+    if (worldSpace)
+    {
+        sceneToCamera = rp->getViewMatrix();
+        cameraToScene = sceneToCamera.invert();
+    }
+    else
+    {
+        sceneToCamera.SetIdentity();
+        cameraToScene.SetIdentity();
+    }
+    eyePosition = (cameraToScene * Homogeneous4(0.0f, 0.0f, 0.0f)).Point();
+
+    Matrix4 sceneTransform = getSceneTransform();
+    lights.resize(rp->lights.size());
+    for (size_t i = 0; i < rp->lights.size(); i++)
+    {
+        Light *l = rp->lights[i];
+        lights[i].position = sceneTransform * l->GetPositionCenter();
+        lights[i].point = sceneTransform * l->GetPositionCenter().Point();
+        lights[i].color = l->GetColor();
+    }
+
+    if (!topLevelDirty && sceneTransform == topLevelTransform)
+        return;
+    topLevelDirty = false;
+    topLevelTransform = sceneTransform;
+    TraceScope topLevelTrace("topLevel", "scene");
+
+    std::vector<AABB> instanceBounds(instances.size());
+    #pragma omp parallel for
+    for (int i = 0; i < int(instances.size()); i++)
+    {
+        Instance &instance = instances[i];
+        instance.transform = sceneTransform * instance.placement;
+        instance.inverse = instance.transform.invert();
+        //the scene transform is only ever a rotation and a translation, which
+        //is its own inverse transpose, so only the placement needs one
+        instance.normalTransform = sceneTransform * instance.normalPlacement;
+
+        //the box around the eight transformed corners of the mesh bounds
+        const AABB &b = meshes[instance.mesh].bounds;
+        instance.bounds = AABB();
+        for (int corner = 0; corner < 8; corner++)
         {
-            mint = t;
-            tri = triangles[i];
+            Cartesian3 c((corner & 1) ? b.max.x : b.min.x, (corner & 2) ? b.max.y : b.min.y, (corner & 4) ? b.max.z : b.min.z);
+            instance.bounds.grow(instance.transform * c);
         }
+        instanceBounds[i] = instance.bounds;
     }
 
-    if (mint == std::numeric_limits<float>::max())
+    //with the BVH disabled closestTriangle falls back to testing every instance
+    if (rp->bvhEnabled)
+        topLevel.build(instanceBounds);
+    else
+        topLevel.clear();
+
+    wideTopLevel.clear();
+    compressedTopLevel.clear();
+    if (rp->bvhEnabled && rp->bvhLayout == BVH_LAYOUT_WIDE)
+        wideTopLevel.build(topLevel);
+    if (rp->bvhEnabled && rp->bvhLayout == BVH_LAYOUT_COMPRESSED)
+        compressedTopLevel.build(topLevel);
+    if (rp->bvhEnabled && rp->bvhLayout != BVH_LAYOUT_BINARY)
+        topLevel.clear();
+}
+
+Scene::CollisionInfo Scene::closestTriangle (Ray r, RenderStats *stats)
+{
+    Scene::CollisionInfo ci;
+    float mint = r.tMax;
+    int hitID = -1;
+    int hitIndex = -1;
+    int hitInstance = -1;
+    Cartesian3 hitBarycentrics;
+
+    auto intersectInstance = [&](int i)
+    {
+        const Instance &instance = instances[i];
+        //the transform is affine, so t means the same in both spaces.
+        //The interval is cut short at the closest hit so far
+        Homogeneous4 o = instance.inverse * Homogeneous4(r.origin);
+        Homogeneous4 d = instance.inverse * Homogeneous4(r.direction.x, r.direction.y, r.direction.z, 0.0f);
+        Ray local(o.Point(), d.Vector(), r.ray_type, r.tMin, mint);
+        if (meshes[instance.mesh].closestHit(local, mint, hitID, hitIndex, hitBarycentrics, stats))
+            hitInstance = i;
+        return false;
+    };
+
+    int visited = 0;
+    if (wideTopLevel.isBuilt())
+    {
+        visited = wideTopLevel.traverse(r, mint, intersectInstance);
+    }
+    else if (compressedTopLevel.isBuilt())
+    {
+        visited = compressedTopLevel.traverse(r, mint, intersectInstance);
+    }
+    else if (topLevel.isBuilt())
     {
-        ci.t = -1.0f;
+        visited = topLevel.traverse(r, mint, intersectInstance);
     }
     else
+    {
+        for (int i = 0; i < int(instances.size()); i++)
+            intersectInstance(i);
+    }
+    if (stats)
+        stats->nodesVisited += visited;
+
+    if (hitInstance != -1)
     {
         ci.t = mint;
-        ci.tri = tri;
+        ci.bc = hitBarycentrics;
+        ci.instance = hitInstance;
+        ci.triangle = hitIndex;
     }
-    // ci.t = r.origin.x; // this is just so it compiles warning free
     return ci;
 }
 
+Material *Scene::hitMaterial(const CollisionInfo &ci) const
+{
+    return meshes[instances[ci.instance].mesh].material;
+}
+
+Cartesian3 Scene::hitPoint(const CollisionInfo &ci) const
+{
+    //the corners are moved into scene space before they are interpolated, so the
+    //point comes out as it did from the flattened scene and sits on the same plane
+    const Instance &instance = instances[ci.instance];
+    const Mesh &mesh = meshes[instance.mesh];
+    Cartesian3 corners[3];
+    for (int corner = 0; corner < 3; corner++)
+        corners[corner] = (instance.transform * Homogeneous4(mesh.position(ci.triangle, corner))).Point();
+    return corners[0] * ci.bc.x + corners[1] * ci.bc.y + corners[2] * ci.bc.z;
+}
+
+Cartesian3 Scene::hitNormal(const CollisionInfo &ci) const
+{
+    const Instance &instance = instances[ci.instance];
+    const Mesh &mesh = meshes[instance.mesh];
+    //the normals go through the inverse transpose, so they stay at right angles
+    //to the surface under a non-uniform scale, and are then put back to unit
+    //length before they are interpolated
+    Cartesian3 corners[3];
+    for (int corner = 0; corner < 3; corner++)
+    {
+        const Cartesian3 &n = mesh.normal(ci.triangle, corner);
+        corners[corner] = (instance.normalTransform * Homogeneous4(n.x, n.y, n.z, 0.0f)).Vector();
+        if (instance.scalesNormals)
+            corners[corner] = corners[corner].unit();
+    }
+    return corners[0] * ci.bc.x + corners[1] * ci.bc.y + corners[2] * ci.bc.z;
+}
+
+Ray Scene::shadowRay(const Cartesian3 &point, const Cartesian3 &normal, const SceneLight &light) const
+{
+    //from just above the surface to just short of the light, so that only what
+    //lies between them can shadow the point, and nothing behind the light
+    Cartesian3 origin = point + SHADOW_EPSILON * normal;
+    Cartesian3 toLight = light.point - origin;
+    return Ray(origin, toLight.unit(), Ray::secondary, 0.0f, toLight.length() - SHADOW_EPSILON);
+}
+
+bool Scene::occluded(Ray r, RenderStats *stats)
+{
+    bool found = false;
+    float tMax = r.tMax;
+    auto intersectInstance = [&](int i)
+    {
+        const Instance &instance = instances[i];
+        Homogeneous4 o = instance.inverse * Homogeneous4(r.origin);
+        Homogeneous4 d = instance.inverse * Homogeneous4(r.direction.x, r.direction.y, r.direction.z, 0.0f);
+        Ray local(o.Point(), d.Vector(), r.ray_type, r.tMin, r.tMax);
+        found = meshes[instance.mesh].occluded(local, stats);
+        return found;
+    };
+
+    int visited = 0;
+    if (wideTopLevel.isBuilt())
+    {
+        visited = wideTopLevel.traverse(r, tMax, intersectInstance);
+    }
+    else if (compressedTopLevel.isBuilt())
+    {
+        visited = compressedTopLevel.traverse(r, tMax, intersectInstance);
+    }
+    else if (topLevel.isBuilt())
+    {
+        visited = topLevel.traverse(r, tMax, intersectInstance);
+    }
+    else
+    {
+        for (int i = 0; i < int(instances.size()) && !found; i++)
+            intersectInstance(i);
+    }
+    if (stats)
+        stats->nodesVisited += visited;
+    return found;
+}
@@ -11,6 +11,8 @@
 //  ------------------------
 //
 //  Contains a definition of a scene, with triangles and transformations.
+//  Each object is a Mesh in its own space with its own BVH, placed in the
+//  scene through an Instance. A small top level BVH sits over the instances.
 //
 ///////////////////////////////////////////////////
 
@@ -23,27 +25,122 @@
 #include "Ray.h"
 #include "Triangle.h"
 #include "Material.h"
+#include "BVH.h"
+#include "Mesh.h"
+#include "RenderParameters.h"
+#include "RenderStats.h"
 
 class Scene
 {
 public:
 
+   //a hit, the triangle itself is looked up through it
    struct CollisionInfo{
-    Triangle tri;
-    float t;
+    //-1 on a miss
+    float t = -1.0f;
+    // barycentric weights of the hit point, from the intersection test
+    Cartesian3 bc;
+    //index into instances, and into the triangles of the instance's mesh
+    int instance = -1;
+    int triangle = -1;
    };
 
-   CollisionInfo closestTriangle(Ray r);
+   struct Instance{
+    int mesh;
+    // where the instance sits in model space, identity for the loaded objects
+    Matrix4 placement;
+    // the inverse transpose of placement, which moves the normals, and whether
+    // it changes their length, as a non-uniform scale does
+    Matrix4 normalPlacement;
+    bool scalesNormals;
+    // mesh space to scene space and back, and the same for normals, refreshed by updateScene
+    Matrix4 transform;
+    Matrix4 inverse;
+    Matrix4 normalTransform;
+    // bounds in scene space
+    AABB bounds;
+   };
+
+   //a light moved into scene space, refreshed by updateScene
+   struct SceneLight{
+    //for the Phong shading
+    Homogeneous4 position;
+    //where the shadow rays aim
+    Cartesian3 point;
+    Homogeneous4 color;
+   };
+
+   //closest hit within the ray's interval, t is -1 on a miss.
+   //The nodes visited and triangles tested are added to stats, if given
+   CollisionInfo closestTriangle(Ray r, RenderStats *stats = nullptr);
+   //any hit query for shadow rays: is there anything but a light within the ray's
+   //interval? It stops at the first such hit
+   bool occluded(Ray r, RenderStats *stats = nullptr);
+   //the shadow ray from a hit point towards a light, to give to occluded.
+   //It ends just short of the light
+   Ray shadowRay(const Cartesian3 &point, const Cartesian3 &normal, const SceneLight &light) const;
+
+   //the material of a hit
+   Material *hitMaterial(const CollisionInfo &ci) const;
+   //position and interpolated normal of a hit in scene space. The normal is not normalised
+   Cartesian3 hitPoint(const CollisionInfo &ci) const;
+   Cartesian3 hitNormal(const CollisionInfo &ci) const;
 
     std::vector<ThreeDModel>* objects;
     RenderParameters* rp;
     Material *default_mat;
 
-    std::vector<Triangle> triangles;
+    //one mesh per object, in object space. A mesh is only rebuilt when the
+    //version of its object changes, a camera move only rebuilds the top level.
+    //Rays are moved into a mesh's space to be tested, which rounds otherwise
+    //than testing the triangles in camera space as the scene once did. Rays
+    //that graze an edge can land the other way: triangle seams, the sphere,
+    //and shadow rays aimed at a light centre on the edge of the light
+    std::vector<Mesh> meshes;
+    //the identity instances of the objects come first, then the added ones
+    std::vector<Instance> instances;
+    //acceleration structure over the instances, only built when rp->bvhEnabled.
+    //Like in Mesh, only the one for rp->bvhLayout is kept
+    BVH topLevel;
+    WideBVH wideTopLevel;
+    CompressedBVH compressedTopLevel;
+
+    //rays are traced and shaded in "scene space". That is VCS, or world
+    //space when rp->worldSpaceRendering is set, in which case the camera
+    //rays are moved into world space instead of the scene into VCS.
+    bool worldSpace = false;
+    //camera (VCS) to scene space and back, refreshed by updateScene
+    Matrix4 cameraToScene;
+    Matrix4 sceneToCamera;
+    //the camera position in scene space, for specular highlights
+    Cartesian3 eyePosition;
+    //rp->lights in scene space, so rays do not transform them again
+    std::vector<SceneLight> lights;
 
     Scene(std::vector<ThreeDModel> *texobjs,RenderParameters *renderp);
     void updateScene();
     Matrix4 getModelview();
+    //model space to scene space, e.g. for the lights
+    Matrix4 getSceneTransform();
+    //moves a ray built in VCS into scene space
+    Ray fromCamera(const Ray &r);
+    //places another copy of a mesh in the scene, sharing its triangles.
+    //Added instances outlive BVH and layout changes, but not a new set of
+    //objects, and their index moves when an object gains or loses all its faces
+    int addInstance(int mesh, const Matrix4 &placement);
+
+private:
+    void buildMeshes(const std::vector<int> &rebuild);
+    //the ThreeDModel::version each mesh was built from
+    std::vector<unsigned long> meshVersions;
+    //whether the meshes were last built with a BVH, and in which layout
+    bool meshesUseBVH = false;
+    int meshesLayout = BVH_LAYOUT_BINARY;
+    //how many instances at the front of instances are the objects' own
+    int objectInstances = 0;
+    //the top level is only rebuilt when the instances moved in scene space
+    bool topLevelDirty = true;
+    Matrix4 topLevelTransform;
 };
 
 #endif // SCENE_H
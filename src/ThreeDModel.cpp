@@ -26,6 +26,7 @@
 
 // include the header file
 #include "ThreeDModel.h"
+#include <atomic>
 
 // include the C++ standard libraries we want
 #include <iostream>
@@ -45,8 +46,24 @@ ThreeDModel::ThreeDModel()
     vertices.resize(0);
     normals.resize(0);
     textureCoords.resize(0);
+    geometryChanged();
     } // TexturedObject()
 
+void ThreeDModel::geometryChanged()
+    { // geometryChanged()
+    static std::atomic<unsigned long> nextVersion(1);
+    version = nextVersion++;
+    } // geometryChanged()
+
+size_t ThreeDModel::triangleCount() const
+    { // triangleCount()
+    size_t count = 0;
+    for (const std::vector<unsigned int> &face : faceVertices)
+        if (face.size() > 2)
+            count += face.size() - 2;
+    return count;
+    } // triangleCount()
+
 // read routine returns true on success, failure otherwise
 std::vector<ThreeDModel> ThreeDModel::ReadObjectStreamMaterial(std::istream &geometryStream, std::istream &materialStream)
     { // ReadObjectStreamMaterial()
@@ -68,8 +68,18 @@ class ThreeDModel
     //Material that it might have
     Material *material;
 
+    // identifies the geometry above, no two models share one unless they
+    // are copies. Whoever edits the geometry calls geometryChanged()
+    unsigned long version;
+
     // constructor will initialise to safe values
     ThreeDModel();
+
+    // gives the model a new version, so Scene rebuilds its mesh
+    void geometryChanged();
+
+    // number of triangles once the faces are fanned out
+    size_t triangleCount() const;
     
     // read routine returns true on success, failure otherwise
     static std::vector<ThreeDModel> ReadObjectStream(std::istream &geometryStream);
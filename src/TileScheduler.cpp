@@ -0,0 +1,91 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  University of Leeds
+//  COMP 5892M Advanced Rendering
+//  User Interface for Coursework
+////////////////////////////////////////////////////////////////////////
+
+#include "TileScheduler.h"
+#include <algorithm>
+
+// spreads the low 16 bits of v out to the even bits
+static unsigned int spreadBits(unsigned int v)
+{
+    v &= 0x0000ffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+void TileScheduler::reset(int newWidth, int newHeight, int newWorkerCount)
+{
+    if (newWidth != width || newHeight != height)
+    {
+        width = newWidth;
+        height = newHeight;
+        int columns = (width + TILE_SIZE - 1) / TILE_SIZE;
+        int rows = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+        // tiles sorted on their interleaved column and row bits
+        std::vector<std::pair<unsigned int, Tile>> ordered;
+        ordered.reserve(size_t(columns) * size_t(rows));
+        for (int row = 0; row < rows; row++)
+            for (int column = 0; column < columns; column++)
+            {
+                Tile tile;
+                tile.x0 = column * TILE_SIZE;
+                tile.y0 = row * TILE_SIZE;
+                tile.x1 = std::min(tile.x0 + TILE_SIZE, width);
+                tile.y1 = std::min(tile.y0 + TILE_SIZE, height);
+                ordered.push_back({spreadBits(column) | (spreadBits(row) << 1), tile});
+            }
+        std::sort(ordered.begin(), ordered.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+
+        tiles.clear();
+        for (const auto &entry : ordered)
+            tiles.push_back(entry.second);
+    }
+
+    if (newWorkerCount != workerCount)
+    {
+        workerCount = std::max(1, newWorkerCount);
+        queues.reset(new Queue[workerCount]);
+    }
+
+    // an even share of the Morton order each
+    int count = tileCount();
+    for (int w = 0; w < workerCount; w++)
+    {
+        std::lock_guard<std::mutex> guard(queues[w].lock);
+        queues[w].begin = int((long long)count * w / workerCount);
+        queues[w].end = int((long long)count * (w + 1) / workerCount);
+    }
+}
+
+bool TileScheduler::next(int worker, Tile &tile)
+{
+    {
+        Queue &own = queues[worker];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (own.begin < own.end)
+        {
+            tile = tiles[own.begin++];
+            return true;
+        }
+    }
+
+    // steal the last tile of the first worker found with some left
+    for (int i = 1; i < workerCount; i++)
+    {
+        Queue &victim = queues[(worker + i) % workerCount];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (victim.begin < victim.end)
+        {
+            tile = tiles[--victim.end];
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,67 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  University of Leeds
+//  COMP 5892M Advanced Rendering
+//  User Interface for Coursework
+//
+//  September, 2022
+//
+//  ------------------------
+//  TileScheduler.h
+//  ------------------------
+//
+//  Splits a frame into square tiles and hands them out to worker threads.
+//  The tiles are laid out in Morton order, and every worker starts with a
+//  contiguous run of them, so what it renders stays close together. A
+//  worker that runs out steals from the far end of another worker's run.
+//
+///////////////////////////////////////////////////
+
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <vector>
+#include <mutex>
+#include <memory>
+
+// width and height of a tile in pixels
+#define TILE_SIZE 16
+
+class TileScheduler
+{
+
+public:
+
+    // the pixels [x0, x1) x [y0, y1)
+    struct Tile{
+        int x0, y0;
+        int x1, y1;
+    };
+
+    // lays out the tiles of a frame, if its size changed, and shares them out again
+    void reset(int width, int height, int workerCount);
+    // the next tile for a worker: its own if it has any left, a stolen one otherwise.
+    // False once the frame is all handed out
+    bool next(int worker, Tile &tile);
+
+    int tileCount() const { return int(tiles.size()); }
+    int workers() const { return workerCount; }
+
+private:
+
+    // a worker's run of tiles, [begin, end) in Morton order. The owner takes
+    // from the front and thieves from the back. Padded to its own cache line
+    struct alignas(64) Queue{
+        std::mutex lock;
+        int begin = 0;
+        int end = 0;
+    };
+
+    std::vector<Tile> tiles;
+    int width = 0;
+    int height = 0;
+    int workerCount = 0;
+    std::unique_ptr<Queue[]> queues;
+};
+
+#endif // TILE_SCHEDULER_H
@@ -0,0 +1,171 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  University of Leeds
+//  COMP 5892M Advanced Rendering
+//  User Interface for Coursework
+////////////////////////////////////////////////////////////////////////
+
+#include "TraceRecorder.h"
+#include <atomic>
+#include <iomanip>
+#include <mutex>
+#include <memory>
+#include <vector>
+
+namespace
+{
+    // the events of one thread. Only that thread adds to them, the lock is
+    // for start() and writeJson(), which may come from any thread
+    struct ThreadEvents{
+        std::mutex lock;
+        int id;
+        std::string name;
+        std::vector<TraceRecorder::Event> events;
+    };
+
+    std::atomic<bool> recording{false};
+    // steady clock nanoseconds at start()
+    std::atomic<long long> origin{0};
+
+    // every thread that ever recorded, they are kept after it ends
+    std::mutex threadsLock;
+    std::vector<std::unique_ptr<ThreadEvents>> threads;
+    thread_local ThreadEvents *ownEvents = nullptr;
+
+    long long steadyNanoseconds()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    ThreadEvents &threadEvents()
+    {
+        if (ownEvents == nullptr)
+        {
+            std::lock_guard<std::mutex> guard(threadsLock);
+            threads.push_back(std::make_unique<ThreadEvents>());
+            ownEvents = threads.back().get();
+            ownEvents->id = int(threads.size());
+        }
+        return *ownEvents;
+    }
+
+    // names are ours or literals, but a quote would still break the file
+    void writeString(std::ostream &out, const char *text)
+    {
+        out << '"';
+        for (const char *c = text; *c; c++)
+        {
+            if (*c == '"' || *c == '\\')
+                out << '\\';
+            out << *c;
+        }
+        out << '"';
+    }
+}
+
+void TraceRecorder::start()
+{
+    {
+        std::lock_guard<std::mutex> guard(threadsLock);
+        for (auto &thread : threads)
+        {
+            std::lock_guard<std::mutex> threadGuard(thread->lock);
+            thread->events.clear();
+        }
+    }
+    origin = steadyNanoseconds();
+    recording = true;
+}
+
+void TraceRecorder::stop()
+{
+    recording = false;
+}
+
+bool TraceRecorder::enabled()
+{
+    return recording.load(std::memory_order_relaxed);
+}
+
+double TraceRecorder::now()
+{
+    return double(steadyNanoseconds() - origin.load(std::memory_order_relaxed)) * 1e-3;
+}
+
+void TraceRecorder::nameThread(const std::string &name)
+{
+    ThreadEvents &own = threadEvents();
+    std::lock_guard<std::mutex> guard(own.lock);
+    own.name = name;
+}
+
+void TraceRecorder::instant(const char *name, const char *category)
+{
+    if (!enabled())
+        return;
+    Event event;
+    event.name = name;
+    event.category = category;
+    event.begin = now();
+    event.duration = -1.0;
+    event.argCount = 0;
+    record(event);
+}
+
+void TraceRecorder::record(const Event &event)
+{
+    if (!enabled())
+        return;
+    ThreadEvents &own = threadEvents();
+    std::lock_guard<std::mutex> guard(own.lock);
+    own.events.push_back(event);
+}
+
+void TraceRecorder::writeJson(std::ostream &out)
+{
+    std::lock_guard<std::mutex> guard(threadsLock);
+    // microseconds, down to the nanosecond however long the trace
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"raytracer\"}}";
+    for (auto &thread : threads)
+    {
+        std::lock_guard<std::mutex> threadGuard(thread->lock);
+        if (!thread->name.empty())
+        {
+            out << "," << std::endl << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->id << ",\"args\":{\"name\":";
+            writeString(out, thread->name.c_str());
+            out << "}}";
+        }
+        for (const Event &event : thread->events)
+        {
+            out << "," << std::endl << "{\"name\":";
+            writeString(out, event.name);
+            out << ",\"cat\":";
+            writeString(out, event.category);
+            out << ",\"pid\":1,\"tid\":" << thread->id << ",\"ts\":" << event.begin;
+            if (event.duration < 0.0)
+                out << ",\"ph\":\"i\",\"s\":\"t\"";
+            else
+                out << ",\"ph\":\"X\",\"dur\":" << event.duration;
+            if (event.argCount > 0)
+            {
+                out << ",\"args\":{";
+                for (int i = 0; i < event.argCount; i++)
+                {
+                    if (i > 0)
+                        out << ",";
+                    writeString(out, event.argNames[i]);
+                    out << ":" << event.args[i];
+                }
+                out << "}";
+            }
+            out << "}";
+        }
+    }
+    out << std::endl << "]}" << std::endl;
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,115 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  University of Leeds
+//  COMP 5892M Advanced Rendering
+//  User Interface for Coursework
+//
+//  September, 2022
+//
+//  ------------------------
+//  TraceRecorder.h
+//  ------------------------
+//
+//  A timeline of what every thread did, written out as Chrome trace
+//  events for chrome://tracing or Perfetto. A TraceScope marks one span,
+//  from its construction to the end of its block. Each thread keeps its
+//  own list of events, so recording only ever takes a lock nobody else
+//  wants, and when tracing is off a scope is a single flag check.
+//
+///////////////////////////////////////////////////
+
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <chrono>
+#include <ostream>
+#include <string>
+
+// at most this many named integers per event
+#define TRACE_MAX_ARGS 3
+
+class TraceRecorder
+{
+
+public:
+
+    // one span, or one instant when duration is negative. Times are in
+    // microseconds since start(). The strings are literals and are not copied
+    struct Event{
+        const char *name;
+        const char *category;
+        double begin;
+        double duration;
+        int argCount;
+        const char *argNames[TRACE_MAX_ARGS];
+        long args[TRACE_MAX_ARGS];
+    };
+
+    // forgets the events recorded so far and records from now on
+    static void start();
+    static void stop();
+    static bool enabled();
+
+    // the name the calling thread shows under in the trace
+    static void nameThread(const std::string &name);
+    // a point in time on the calling thread, e.g. a cancelled frame
+    static void instant(const char *name, const char *category);
+    // adds an event to the calling thread's list, if recording
+    static void record(const Event &event);
+    // microseconds since start()
+    static double now();
+
+    // everything recorded, as a Chrome trace JSON object
+    static void writeJson(std::ostream &out);
+
+};
+
+// a span from here to the end of the block, on the calling thread
+class TraceScope
+{
+
+public:
+
+    TraceScope(const char *name, const char *category);
+    ~TraceScope();
+    // a number to show with the span, such as the tile it rendered
+    void arg(const char *name, long value);
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    bool active;
+    TraceRecorder::Event event;
+
+};
+
+inline TraceScope::TraceScope(const char *name, const char *category)
+    : active(TraceRecorder::enabled())
+{
+    if (!active)
+        return;
+    event.name = name;
+    event.category = category;
+    event.argCount = 0;
+    event.begin = TraceRecorder::now();
+}
+
+inline TraceScope::~TraceScope()
+{
+    if (!active)
+        return;
+    event.duration = TraceRecorder::now() - event.begin;
+    TraceRecorder::record(event);
+}
+
+inline void TraceScope::arg(const char *name, long value)
+{
+    if (!active || event.argCount == TRACE_MAX_ARGS)
+        return;
+    event.argNames[event.argCount] = name;
+    event.args[event.argCount] = value;
+    event.argCount++;
+}
+
+#endif // TRACE_RECORDER_H
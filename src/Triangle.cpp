@@ -88,6 +88,9 @@ float Triangle::intersect(Ray r)
         }
     }
 
+    // outside the interval of the ray is a miss too
+    if (t <= r.tMin || t > r.tMax)
+        return -1.0f;
     return t;
 
 }
@@ -123,62 +126,3 @@ Cartesian3 Triangle::baricentric(Cartesian3 o)
     return bc;
 
 }
-
-Homogeneous4 Triangle::phongShading(Homogeneous4 lightPos, Homogeneous4 lightColor, Cartesian3 bc)
-{
-     
-    Homogeneous4 color;
-
-    // interpolate normals
-    Cartesian3 Na = normals[0].Vector();
-    Cartesian3 Nb = normals[1].Vector();
-    Cartesian3 Nc = normals[2].Vector();
-
-    Cartesian3 normal = (Na * bc.x + Nb * bc.y + Nc * bc.z).unit();
-
-    Cartesian3 position = verts[0].Point() * bc.x + verts[1].Point() * bc.y + verts[2].Point() * bc.z;
-    Cartesian3 l = (lightPos.Point() - position).unit();
-    Cartesian3 LIGHT_COLOR = lightColor.Vector();
-
-    // ambient
-    Cartesian3 ambient = Cartesian3(shared_material->ambient.x * LIGHT_COLOR.x , shared_material->ambient.y * LIGHT_COLOR.y, shared_material->ambient.z * LIGHT_COLOR.z);
-
-    // diffuse
-    float cosTheta = std::clamp(normal.dot(l), 0.0f, 1.0f);
-    Cartesian3 diffuse = (shared_material->diffuse);
-    diffuse = Cartesian3(diffuse.x * LIGHT_COLOR.x , diffuse.y * LIGHT_COLOR.y , diffuse.z * LIGHT_COLOR.z);
-    diffuse = diffuse * cosTheta;
-
-    // specular
-    Cartesian3 e = (Cartesian3(0,0,0) - position).unit();
-    Cartesian3 B = (l + e).unit();
-    float cosB = std::clamp(normal.dot(B), 0.0f, 1.0f);
-
-    cosB = std::clamp(pow(cosB, shared_material->shininess), 0.0f, 1.0f);
-
-    cosB = cosB * cosTheta * (shared_material->shininess + 2) / (2*M_PI);
-
-    Cartesian3 specular = (shared_material->specular);
-    specular = Cartesian3(specular.x * LIGHT_COLOR.x , specular.y * LIGHT_COLOR.y , specular.z * LIGHT_COLOR.z);
-    specular = specular * cosB;
-
-    color = diffuse + specular + ambient;
-
-    return color;
-
-}
-
-
-Homogeneous4 Triangle::shadowShading(Homogeneous4 lightColor)
-{
-    Homogeneous4 color;
-
-    Cartesian3 LIGHT_COLOR = lightColor.Vector();
-
-    // ambient
-    Cartesian3 ambient = Cartesian3(shared_material->ambient.x * LIGHT_COLOR.x , shared_material->ambient.y * LIGHT_COLOR.y, shared_material->ambient.z * LIGHT_COLOR.z);
-
-    color = ambient;
-
-    return color;
-}
\ No newline at end of file
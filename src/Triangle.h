@@ -14,7 +14,6 @@ public:
     int triangle_id;
     Homogeneous4 verts[3];
     Homogeneous4 normals[3];
-    Homogeneous4 colors[3];
     Cartesian3 uvs[3];
 
     Material *shared_material;
@@ -24,8 +23,6 @@ public:
     bool isValid();
     float intersect(Ray r);
     Cartesian3 baricentric(Cartesian3 o);
-    Homogeneous4 phongShading(Homogeneous4 lightPos, Homogeneous4 lightColor, Cartesian3 bc);
-    Homogeneous4 shadowShading(Homogeneous4 lightColor);
 
 
 };
@@ -0,0 +1,175 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  University of Leeds
+//  COMP 5892M Advanced Rendering
+//  User Interface for Coursework
+//
+//  September, 2022
+//
+//  ------------------------
+//  TrianglePacket.h
+//  ------------------------
+//
+//  The vertex positions of eight triangles, one array per coordinate, so
+//  that a ray is tested against all of them at once with AVX2. It runs
+//  the same watertight test as WatertightTriangle, lane by lane.
+//
+///////////////////////////////////////////////////
+
+#ifndef TRIANGLE_PACKET_H
+#define TRIANGLE_PACKET_H
+
+#include <cmath>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "WatertightTriangle.h"
+
+class alignas(32) TrianglePacket
+{
+
+public:
+
+    static constexpr int width = 8;
+
+    // coordinates of the three vertices, lane by lane
+    float v0x[width], v0y[width], v0z[width];
+    float v1x[width], v1y[width], v1z[width];
+    float v2x[width], v2y[width], v2z[width];
+    // index of the triangle in each lane, -1 for an empty lane
+    int index[width];
+
+    // an empty packet. Empty lanes are collapsed to a point, which never hits
+    TrianglePacket();
+    // puts a triangle into a lane
+    void set(int lane, const Cartesian3 &a, const Cartesian3 &b, const Cartesian3 &c, int triangleIndex);
+
+    // tests all the lanes. Returns a bit mask of the lanes hit with
+    // tMin < t <= tMax, their distances go to t and their barycentric
+    // weights of v0, v1 and v2 to u, v and w
+    inline int intersect(const ShearedRay &r, float tMax, float *t, float *u, float *v, float *w) const;
+
+};
+
+inline TrianglePacket::TrianglePacket()
+{
+    for (int lane = 0; lane < width; lane++)
+    {
+        v0x[lane] = v0y[lane] = v0z[lane] = 0.0f;
+        v1x[lane] = v1y[lane] = v1z[lane] = 0.0f;
+        v2x[lane] = v2y[lane] = v2z[lane] = 0.0f;
+        index[lane] = -1;
+    }
+}
+
+inline void TrianglePacket::set(int lane, const Cartesian3 &a, const Cartesian3 &b, const Cartesian3 &c, int triangleIndex)
+{
+    v0x[lane] = a.x; v0y[lane] = a.y; v0z[lane] = a.z;
+    v1x[lane] = b.x; v1y[lane] = b.y; v1z[lane] = b.z;
+    v2x[lane] = c.x; v2y[lane] = c.y; v2z[lane] = c.z;
+    index[lane] = triangleIndex;
+}
+
+#ifdef __AVX2__
+
+namespace TrianglePacketDetail
+{
+    // one sheared coordinate of eight vertices, the row dotted with (vertex - origin)
+    inline __m256 shear(const float *x, const float *y, const float *z, const Cartesian3 &origin, const Cartesian3 &row)
+    {
+        __m256 dx = _mm256_sub_ps(_mm256_load_ps(x), _mm256_set1_ps(origin.x));
+        __m256 dy = _mm256_sub_ps(_mm256_load_ps(y), _mm256_set1_ps(origin.y));
+        __m256 dz = _mm256_sub_ps(_mm256_load_ps(z), _mm256_set1_ps(origin.z));
+        __m256 result = _mm256_mul_ps(dx, _mm256_set1_ps(row.x));
+        result = _mm256_add_ps(result, _mm256_mul_ps(dy, _mm256_set1_ps(row.y)));
+        return _mm256_add_ps(result, _mm256_mul_ps(dz, _mm256_set1_ps(row.z)));
+    }
+
+    // p * q - r * s of four lanes in double, the products are exact
+    inline __m128 edge(__m128 p, __m128 q, __m128 r, __m128 s)
+    {
+        __m256d pq = _mm256_mul_pd(_mm256_cvtps_pd(p), _mm256_cvtps_pd(q));
+        __m256d rs = _mm256_mul_pd(_mm256_cvtps_pd(r), _mm256_cvtps_pd(s));
+        return _mm256_cvtpd_ps(_mm256_sub_pd(pq, rs));
+    }
+
+    // the same for all eight lanes, a half at a time
+    inline __m256 edge(__m256 p, __m256 q, __m256 r, __m256 s)
+    {
+        __m128 low = edge(_mm256_castps256_ps128(p), _mm256_castps256_ps128(q), _mm256_castps256_ps128(r), _mm256_castps256_ps128(s));
+        __m128 high = edge(_mm256_extractf128_ps(p, 1), _mm256_extractf128_ps(q, 1), _mm256_extractf128_ps(r, 1), _mm256_extractf128_ps(s, 1));
+        return _mm256_set_m128(high, low);
+    }
+}
+
+inline int TrianglePacket::intersect(const ShearedRay &r, float tMax, float *t, float *u, float *v, float *w) const
+{
+    using namespace TrianglePacketDetail;
+
+    __m256 ax = shear(v0x, v0y, v0z, r.origin, r.rowX);
+    __m256 ay = shear(v0x, v0y, v0z, r.origin, r.rowY);
+    __m256 bx = shear(v1x, v1y, v1z, r.origin, r.rowX);
+    __m256 by = shear(v1x, v1y, v1z, r.origin, r.rowY);
+    __m256 cx = shear(v2x, v2y, v2z, r.origin, r.rowX);
+    __m256 cy = shear(v2x, v2y, v2z, r.origin, r.rowY);
+
+    __m256 eu = edge(cx, by, cy, bx);
+    __m256 ev = edge(ax, cy, ay, cx);
+    __m256 ew = edge(bx, ay, by, ax);
+
+    // all three edge functions must agree in sign
+    __m256 zero = _mm256_setzero_ps();
+    __m256 anyNegative = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(eu, zero, _CMP_LT_OQ), _mm256_cmp_ps(ev, zero, _CMP_LT_OQ)), _mm256_cmp_ps(ew, zero, _CMP_LT_OQ));
+    __m256 anyPositive = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(eu, zero, _CMP_GT_OQ), _mm256_cmp_ps(ev, zero, _CMP_GT_OQ)), _mm256_cmp_ps(ew, zero, _CMP_GT_OQ));
+    __m256 det = _mm256_add_ps(_mm256_add_ps(eu, ev), ew);
+    __m256 inside = _mm256_andnot_ps(_mm256_and_ps(anyNegative, anyPositive), _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ));
+    if (_mm256_movemask_ps(inside) == 0)
+        return 0;
+
+    __m256 az = shear(v0x, v0y, v0z, r.origin, r.rowZ);
+    __m256 bz = shear(v1x, v1y, v1z, r.origin, r.rowZ);
+    __m256 cz = shear(v2x, v2y, v2z, r.origin, r.rowZ);
+    // the empty lanes have det 0, so give them 1 to keep infinities out
+    __m256 inverseDet = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_blendv_ps(_mm256_set1_ps(1.0f), det, inside));
+    __m256 hitT = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(eu, az), _mm256_mul_ps(ev, bz)), _mm256_mul_ps(ew, cz));
+    hitT = _mm256_mul_ps(hitT, inverseDet);
+    __m256 inRange = _mm256_and_ps(_mm256_cmp_ps(hitT, _mm256_set1_ps(r.tMin), _CMP_GT_OQ), _mm256_cmp_ps(hitT, _mm256_set1_ps(tMax), _CMP_LE_OQ));
+    int mask = _mm256_movemask_ps(_mm256_and_ps(inside, inRange));
+    if (mask == 0)
+        return 0;
+
+    _mm256_storeu_ps(t, hitT);
+    _mm256_storeu_ps(u, _mm256_mul_ps(eu, inverseDet));
+    _mm256_storeu_ps(v, _mm256_mul_ps(ev, inverseDet));
+    _mm256_storeu_ps(w, _mm256_mul_ps(ew, inverseDet));
+    return mask;
+}
+
+#else
+
+inline int TrianglePacket::intersect(const ShearedRay &r, float tMax, float *t, float *u, float *v, float *w) const
+{
+    ShearedRay clipped = r;
+    clipped.tMax = tMax;
+    int mask = 0;
+    for (int lane = 0; lane < width; lane++)
+    {
+        WatertightTriangle triangle;
+        triangle.v0 = Cartesian3(v0x[lane], v0y[lane], v0z[lane]);
+        triangle.v1 = Cartesian3(v1x[lane], v1y[lane], v1z[lane]);
+        triangle.v2 = Cartesian3(v2x[lane], v2y[lane], v2z[lane]);
+        Cartesian3 bc;
+        if (triangle.intersect(clipped, t[lane], bc))
+        {
+            u[lane] = bc.x;
+            v[lane] = bc.y;
+            w[lane] = bc.z;
+            mask |= 1 << lane;
+        }
+    }
+    return mask;
+}
+
+#endif
+
+#endif // TRIANGLE_PACKET_H
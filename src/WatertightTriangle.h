@@ -0,0 +1,120 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  University of Leeds
+//  COMP 5892M Advanced Rendering
+//  User Interface for Coursework
+//
+//  September, 2022
+//
+//  ------------------------
+//  WatertightTriangle.h
+//  ------------------------
+//
+//  The ray-triangle test used by the meshes: the watertight algorithm of
+//  Woop, Benthin and Wald (JCGT 2013). The ray is sheared once so that it
+//  runs down +z from the origin, then each triangle only needs three 2D
+//  edge functions. Two triangles sharing an edge compute that edge's
+//  function from the same numbers, so no ray can slip between them.
+//
+///////////////////////////////////////////////////
+
+#ifndef WATERTIGHT_TRIANGLE_H
+#define WATERTIGHT_TRIANGLE_H
+
+#include <cmath>
+#include <utility>
+#include "Cartesian3.h"
+#include "Ray.h"
+#include "Triangle.h"
+
+// a ray set up for the watertight test, done once per ray and mesh
+class ShearedRay
+{
+public:
+    Cartesian3 origin;
+    // the shear as three rows, made of 0, 1, -Sx, -Sy and Sz, so applying
+    // them only rounds where the algorithm itself does
+    Cartesian3 rowX, rowY, rowZ;
+    float tMin, tMax;
+
+    inline ShearedRay(const Ray &r);
+};
+
+// the vertices of a triangle, laid out for the intersection test
+class WatertightTriangle
+{
+public:
+    Cartesian3 v0, v1, v2;
+
+    inline WatertightTriangle() {}
+    inline WatertightTriangle(const Triangle &t)
+        : v0(t.verts[0].Point()), v1(t.verts[1].Point()), v2(t.verts[2].Point())
+    {}
+
+    // true on a hit with tMin < t <= tMax. bc gets the barycentric
+    // weights of v0, v1 and v2, in the same order as Triangle::baricentric
+    inline bool intersect(const ShearedRay &r, float &t, Cartesian3 &bc) const;
+};
+
+inline ShearedRay::ShearedRay(const Ray &r) : origin(r.origin), tMin(r.tMin), tMax(r.tMax)
+{
+    // kz is the dominant axis of the direction. kx and ky follow it, swapped
+    // if it points backwards, to keep the winding of the triangles
+    Cartesian3 d = r.direction;
+    float ax = std::fabs(d.x), ay = std::fabs(d.y), az = std::fabs(d.z);
+    int kz = ax > ay ? (ax > az ? 0 : 2) : (ay > az ? 1 : 2);
+    int kx = (kz + 1) % 3;
+    int ky = (kx + 1) % 3;
+    float dz = kz == 0 ? d.x : (kz == 1 ? d.y : d.z);
+    if (dz < 0.0f)
+        std::swap(kx, ky);
+
+    float dx = kx == 0 ? d.x : (kx == 1 ? d.y : d.z);
+    float dy = ky == 0 ? d.x : (ky == 1 ? d.y : d.z);
+    float sx = dx / dz, sy = dy / dz, sz = 1.0f / dz;
+
+    auto axis = [](int k, float value)
+    {
+        return Cartesian3(k == 0 ? value : 0.0f, k == 1 ? value : 0.0f, k == 2 ? value : 0.0f);
+    };
+    rowX = axis(kx, 1.0f) + axis(kz, -sx);
+    rowY = axis(ky, 1.0f) + axis(kz, -sy);
+    rowZ = axis(kz, sz);
+}
+
+inline bool WatertightTriangle::intersect(const ShearedRay &r, float &t, Cartesian3 &bc) const
+{
+    Cartesian3 a = v0 - r.origin;
+    Cartesian3 b = v1 - r.origin;
+    Cartesian3 c = v2 - r.origin;
+
+    float ax = r.rowX.dot(a), ay = r.rowY.dot(a);
+    float bx = r.rowX.dot(b), by = r.rowY.dot(b);
+    float cx = r.rowX.dot(c), cy = r.rowY.dot(c);
+
+    // edge functions, each one is the weight of the opposite vertex. The
+    // products are exact in double, so the triangle on the other side of an
+    // edge gets exactly the negated value, however the compiler fuses them
+    float u = float(double(cx) * double(by) - double(cy) * double(bx));
+    float v = float(double(ax) * double(cy) - double(ay) * double(cx));
+    float w = float(double(bx) * double(ay) - double(by) * double(ax));
+
+    if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f))
+        return false;
+
+    float det = u + v + w;
+    if (det == 0.0f)
+        return false;
+
+    float az = r.rowZ.dot(a), bz = r.rowZ.dot(b), cz = r.rowZ.dot(c);
+    float inverseDet = 1.0f / det;
+    float hitT = (u * az + v * bz + w * cz) * inverseDet;
+    if (hitT <= r.tMin || hitT > r.tMax)
+        return false;
+
+    t = hitT;
+    bc = Cartesian3(u * inverseDet, v * inverseDet, w * inverseDet);
+    return true;
+}
+
+#endif // WATERTIGHT_TRIANGLE_H
@@ -0,0 +1,108 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  University of Leeds
+//  COMP 5892M Advanced Rendering
+//  User Interface for Coursework
+////////////////////////////////////////////////////////////////////////
+
+#include "WideBVH.h"
+#include <chrono>
+
+void WideBVH::clear()
+{
+    std::vector<Node>().swap(nodes);
+    std::vector<int>().swap(primitiveIndices);
+}
+
+void WideBVH::build(const BVH &binary)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    clear();
+    buildTime = 0.0f;
+    if (!binary.isBuilt())
+        return;
+
+    // the leaves are kept as they are, so their primitive ranges still hold
+    primitiveIndices = binary.primitiveIndices;
+    // every wide node replaces at least one binary interior node
+    nodes.reserve(binary.nodes.size() / 2 + 1);
+    collapse(binary, 0);
+    nodes.shrink_to_fit();
+
+    buildTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+}
+
+// the children of a wide node are found by opening up the binary subtree
+// below it, always opening the biggest interior node first, until there
+// are width of them or only leaves are left
+int WideBVH::collapse(const BVH &binary, int binaryNode)
+{
+    int children[width];
+    int childCount = 0;
+    if (binary.nodes[binaryNode].isLeaf())
+    {
+        // only happens when the whole tree is a single leaf
+        children[childCount++] = binaryNode;
+    }
+    else
+    {
+        children[childCount++] = binary.nodes[binaryNode].leftFirst;
+        children[childCount++] = binary.nodes[binaryNode].leftFirst + 1;
+    }
+
+    while (childCount < width)
+    {
+        int best = -1;
+        float bestArea = -1.0f;
+        for (int i = 0; i < childCount; i++)
+        {
+            const BVH::Node &child = binary.nodes[children[i]];
+            if (!child.isLeaf() && child.bounds.halfArea() > bestArea)
+            {
+                best = i;
+                bestArea = child.bounds.halfArea();
+            }
+        }
+        if (best == -1)
+            break;
+
+        int opened = children[best];
+        children[best] = binary.nodes[opened].leftFirst;
+        children[childCount++] = binary.nodes[opened].leftFirst + 1;
+    }
+
+    int nodeIndex = int(nodes.size());
+    nodes.emplace_back();
+    // the empty lanes get a harmless box, they are masked off by childCount
+    for (int i = 0; i < width; i++)
+    {
+        nodes[nodeIndex].minX[i] = nodes[nodeIndex].minY[i] = nodes[nodeIndex].minZ[i] = 0.0f;
+        nodes[nodeIndex].maxX[i] = nodes[nodeIndex].maxY[i] = nodes[nodeIndex].maxZ[i] = 0.0f;
+        nodes[nodeIndex].child[i] = -1;
+        nodes[nodeIndex].count[i] = 0;
+    }
+    nodes[nodeIndex].childCount = childCount;
+
+    for (int i = 0; i < childCount; i++)
+    {
+        const BVH::Node &child = binary.nodes[children[i]];
+        int target;
+        if (child.isLeaf())
+            target = child.leftFirst;
+        else
+            target = collapse(binary, children[i]);
+
+        // nodes may have moved while collapsing the child
+        Node &node = nodes[nodeIndex];
+        node.minX[i] = child.bounds.min.x;
+        node.minY[i] = child.bounds.min.y;
+        node.minZ[i] = child.bounds.min.z;
+        node.maxX[i] = child.bounds.max.x;
+        node.maxY[i] = child.bounds.max.y;
+        node.maxZ[i] = child.bounds.max.z;
+        node.child[i] = target;
+        node.count[i] = child.isLeaf() ? child.count : 0;
+    }
+    return nodeIndex;
+}
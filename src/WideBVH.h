@@ -0,0 +1,189 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  University of Leeds
+//  COMP 5892M Advanced Rendering
+//  User Interface for Coursework
+//
+//  September, 2022
+//
+//  ------------------------
+//  WideBVH.h
+//  ------------------------
+//
+//  An 8-wide bounding volume hierarchy, collapsed from a binary BVH.
+//  Every node keeps the boxes of its children in SoA layout so that
+//  all eight are tested with one AVX2 slab test.
+//
+///////////////////////////////////////////////////
+
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include <vector>
+#include <limits>
+#include <bit>
+#include "BVH.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+class WideBVH
+{
+
+public:
+
+    static constexpr int width = 8;
+
+    struct alignas(32) Node{
+        // child boxes, one lane per child
+        float minX[width], minY[width], minZ[width];
+        float maxX[width], maxY[width], maxZ[width];
+        // interior child: index of its node
+        // leaf child: index of its first entry in primitiveIndices
+        int child[width];
+        // number of primitives in a leaf child, 0 for interior children
+        int count[width];
+        // children are packed at the front, the other lanes are empty
+        int childCount;
+    };
+
+    std::vector<Node> nodes;
+    // primitive ids in leaf order, the same as in the binary tree
+    std::vector<int> primitiveIndices;
+    // wall clock seconds spent collapsing the binary tree
+    float buildTime = 0.0f;
+
+    // collapses a built binary tree, keeping its leaves
+    void build(const BVH &binary);
+    void clear();
+    inline bool isBuilt() const {return !nodes.empty();}
+
+    // same contract as BVH::traverse
+    template <typename PrimitiveFunction>
+    int traverse(const Ray &r, float &tMax, PrimitiveFunction intersectPrimitive) const;
+
+private:
+    int collapse(const BVH &binary, int binaryNode);
+
+    // slab test of all the children of a node. Returns a bit per child that
+    // is hit within [tMin, tMax], with the entry distances in t
+    static inline int intersectChildren(const Node &node, const Cartesian3 &origin, const Cartesian3 &invDir, float tMin, float tMax, float *t);
+
+};
+
+inline int WideBVH::intersectChildren(const Node &node, const Cartesian3 &origin, const Cartesian3 &invDir, float tMin, float tMax, float *t)
+{
+#ifdef __AVX2__
+    __m256 ox = _mm256_set1_ps(origin.x), oy = _mm256_set1_ps(origin.y), oz = _mm256_set1_ps(origin.z);
+    __m256 ix = _mm256_set1_ps(invDir.x), iy = _mm256_set1_ps(invDir.y), iz = _mm256_set1_ps(invDir.z);
+
+    __m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minX), ox), ix);
+    __m256 tx2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxX), ox), ix);
+    __m256 tmin = _mm256_min_ps(tx1, tx2);
+    __m256 tmax = _mm256_max_ps(tx1, tx2);
+
+    __m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minY), oy), iy);
+    __m256 ty2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxY), oy), iy);
+    tmin = _mm256_max_ps(tmin, _mm256_min_ps(ty1, ty2));
+    tmax = _mm256_min_ps(tmax, _mm256_max_ps(ty1, ty2));
+
+    __m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minZ), oz), iz);
+    __m256 tz2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxZ), oz), iz);
+    tmin = _mm256_max_ps(tmin, _mm256_min_ps(tz1, tz2));
+    tmax = _mm256_min_ps(tmax, _mm256_max_ps(tz1, tz2));
+
+    // the same tolerances as BVH::intersectBox, so both trees find the same nodes
+    tmax = _mm256_mul_ps(tmax, _mm256_set1_ps(BVH::boxTolerance));
+    tmin = _mm256_max_ps(tmin, _mm256_set1_ps(tMin));
+    __m256 hit = _mm256_and_ps(_mm256_cmp_ps(tmax, tmin, _CMP_GE_OQ),
+                               _mm256_cmp_ps(tmin, _mm256_set1_ps(tMax * BVH::boxTolerance), _CMP_LE_OQ));
+    _mm256_storeu_ps(t, tmin);
+    return _mm256_movemask_ps(hit) & ((1 << node.childCount) - 1);
+#else
+    int mask = 0;
+    for (int i = 0; i < node.childCount; i++)
+    {
+        AABB box(Cartesian3(node.minX[i], node.minY[i], node.minZ[i]), Cartesian3(node.maxX[i], node.maxY[i], node.maxZ[i]));
+        t[i] = BVH::intersectBox(box, origin, invDir, tMin, tMax);
+        if (t[i] != std::numeric_limits<float>::max())
+            mask |= 1 << i;
+    }
+    return mask;
+#endif
+}
+
+template <typename PrimitiveFunction>
+int WideBVH::traverse(const Ray &r, float &tMax, PrimitiveFunction intersectPrimitive) const
+{
+    if (nodes.empty())
+        return 0;
+
+    Cartesian3 invDir = BVH::inverseDirection(r.direction);
+
+    // leaves go on the stack too, so that everything is visited near first.
+    // Each node pushes at most width - 1 entries, and the depth is capped by the binary tree
+    struct StackEntry{
+        int index;
+        int count;
+        float t;
+    };
+    StackEntry stack[(width - 1) * 64];
+    int stackSize = 0;
+    stack[stackSize++] = {0, 0, 0.0f};
+    int visited = 0;
+
+    while (stackSize > 0)
+    {
+        StackEntry entry = stack[--stackSize];
+        // something closer may have been found since this entry was pushed
+        if (entry.t > tMax * BVH::boxTolerance)
+            continue;
+
+        // walk down through the nearest child, pushing the others
+        while (entry.count == 0)
+        {
+            visited++;
+            const Node &node = nodes[entry.index];
+            alignas(32) float t[width];
+            int mask = intersectChildren(node, r.origin, invDir, r.tMin, tMax, t);
+            if (mask == 0)
+            {
+                entry.count = -1;
+                break;
+            }
+
+            int i = std::countr_zero(unsigned(mask));
+            mask &= mask - 1;
+            StackEntry nearest = {node.child[i], node.count[i], t[i]};
+            // the other hit children are sorted far to near, so the nearest is popped first
+            int first = stackSize;
+            while (mask != 0)
+            {
+                i = std::countr_zero(unsigned(mask));
+                mask &= mask - 1;
+                StackEntry child = {node.child[i], node.count[i], t[i]};
+                if (child.t < nearest.t)
+                    std::swap(child, nearest);
+                int j = stackSize++;
+                while (j > first && stack[j - 1].t < child.t)
+                {
+                    stack[j] = stack[j - 1];
+                    j--;
+                }
+                stack[j] = child;
+            }
+            entry = nearest;
+        }
+
+        if (entry.count < 0)
+            continue;
+        visited++;
+        for (int i = entry.index; i < entry.index + entry.count; i++)
+            if (intersectPrimitive(primitiveIndices[i]))
+                return visited;
+    }
+    return visited;
+}
+
+#endif // WIDE_BVH_H
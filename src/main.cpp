@@ -12,6 +12,7 @@ using namespace std;
 
 #include "ThreeDModel.h"
 #include "Raytracer.h"
+#include "TraceRecorder.h"
 
 // Variables 
 GLFWwindow* window;
@@ -70,6 +71,51 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 		renderParameters.monteCarloEnabled = !renderParameters.monteCarloEnabled;
 		renderParameters.printSettings();
 	}
+	if (key == GLFW_KEY_8 && action == GLFW_PRESS) {
+		renderParameters.bvhEnabled = !renderParameters.bvhEnabled;
+		renderParameters.printSettings();
+	}
+	if (key == GLFW_KEY_9 && action == GLFW_PRESS) {
+		renderParameters.worldSpaceRendering = !renderParameters.worldSpaceRendering;
+		renderParameters.printSettings();
+	}
+	if (key == GLFW_KEY_0 && action == GLFW_PRESS) {
+		renderParameters.bvhLayout = (renderParameters.bvhLayout + 1) % BVH_LAYOUT_COUNT;
+		renderParameters.printSettings();
+	}
+	if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+		renderParameters.progressiveRendering = !renderParameters.progressiveRendering;
+		renderParameters.printSettings();
+	}
+	if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+		renderParameters.statsEnabled = !renderParameters.statsEnabled;
+		renderParameters.printSettings();
+	}
+	if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+		renderParameters.heatmapMode = (renderParameters.heatmapMode + 1) % HEATMAP_COUNT;
+		renderParameters.printSettings();
+	}
+	if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+		// the raytraced image as it is, heatmap or not
+		const char *path = renderParameters.heatmapMode != HEATMAP_OFF ? "heatmap.ppm" : "raytrace.ppm";
+		std::ofstream imageFile(path);
+		myRaytracer->frameBuffer.WritePPM(imageFile);
+		std::cout << "Wrote " << path << std::endl;
+	}
+	if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+		renderParameters.tracingEnabled = !renderParameters.tracingEnabled;
+		renderParameters.printSettings();
+		if (renderParameters.tracingEnabled)
+			TraceRecorder::start();
+		else
+		{
+			// for chrome://tracing or ui.perfetto.dev
+			TraceRecorder::stop();
+			std::ofstream traceFile("trace.json");
+			TraceRecorder::writeJson(traceFile);
+			std::cout << "Wrote trace.json" << std::endl;
+		}
+	}
 
 	// Movement
 	if (key == GLFW_KEY_W)
@@ -440,6 +486,7 @@ int main(int argc, char **argv)
 
 	renderParameters.findLights(objects);
 	std::cout << renderParameters.lights.size() << std::endl;
+	TraceRecorder::nameThread("main");
 
 	if (!initializeGL()) return -1;
 
@@ -574,7 +621,10 @@ int main(int argc, char **argv)
 		glViewport(GLint(window_width / 2.0f), 0, GLsizei(window_width / 2.0f), window_height);
 		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_2D, RaytracerTextureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB,GLsizei(window_width / 2.0), window_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, myRaytracer->frameBuffer.block);
+		{
+			TraceScope trace("upload", "display");
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB,GLsizei(window_width / 2.0), window_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, myRaytracer->frameBuffer.block);
+		}
 		glBindVertexArray(RaytracerVAO);
 		glDrawArrays(GL_TRIANGLES, 0, 3);
 